@@ -0,0 +1,511 @@
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <banesa.h>
+
+// Runs the sampler on synthetic graphs and prints one JSON object per line, so that results can be compared from one commit to the next.
+// Graphs are chains, fan-ins (many roots feeding one node) and diamonds (one root, many middle nodes, one join), from 10 to 10000 nodes.
+// Nodes are either cheap, which measures the overhead of the engine, or expensive. Their outputs are RealValue, SE3Value,
+// HiddenValue or a mix of the three. Each configuration is run with and without multithread mode, exporting either to a sink
+// which only serializes the values or to an SQLite database. Allocations are the calls to operator new during the run.
+// The setup of a run (compilation of the graph, creation of the database and of the batches) is reported separately: a second,
+// shorter run fills the pipeline of the first one, and the throughput, the time per node and the allocations per sample are
+// computed from the difference between the two runs, hence they reflect the steady state.
+//
+// usage: banesa_bench [--quick] [--filter <substring of the configuration name>] [--dir <directory of the databases>]
+
+static std::atomic<uint64_t> num_allocations(0);
+
+void* operator new(size_t size)
+{
+    void* ret = std::malloc(size == 0 ? 1 : size);
+
+    if(ret == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    return ret;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept
+{
+    std::free(ptr);
+}
+
+enum class Topology
+{
+    Chain,
+    FanIn,
+    Diamond
+};
+
+enum class Payload
+{
+    Real,
+    SE3,
+    Hidden,
+    Mixed
+};
+
+enum class SinkType
+{
+    Null,
+    SQLite
+};
+
+using HiddenVector = HiddenValue< std::vector<double> >;
+
+struct Config
+{
+    Topology topology;
+    int num_nodes;
+    bool expensive;
+    Payload payload;
+    SinkType sink;
+    int batch_size;
+    bool multithread;
+};
+
+// Serializes the values without storing them, so that only the engine is measured.
+
+class NullSink : public Sink
+{
+public:
+
+    NullSink()
+    {
+        myWriter.checksum = 0.0;
+    }
+
+    bool open(const std::vector<Field>& fields) override
+    {
+        return true;
+    }
+
+    bool write(int sample, const std::vector<ValuePtr>& values) override
+    {
+        int offset = 0;
+
+        for(const ValuePtr& value : values)
+        {
+            value->write(myWriter, offset);
+        }
+
+        return true;
+    }
+
+    bool close() override
+    {
+        return true;
+    }
+
+private:
+
+    struct Writer : public FieldWriter
+    {
+        void writeInteger(int column, int64_t value) override
+        {
+            checksum += double(value);
+        }
+
+        void writeReal(int column, double value) override
+        {
+            checksum += value;
+        }
+
+        void writeText(int column, const std::string& value) override
+        {
+            checksum += double(value.size());
+        }
+
+        void writeBlob(int column, const void* data, size_t size) override
+        {
+            checksum += double(size);
+        }
+
+        double checksum;
+    };
+
+private:
+
+    Writer myWriter;
+};
+
+class BenchNode : public Node
+{
+public:
+
+    BenchNode(int index, const std::vector<int>& dependencies, Payload payload, int work)
+    {
+        myPayload = payload;
+        myWork = work;
+
+        setName("node" + std::to_string(index));
+
+        for(int dependency : dependencies)
+        {
+            registerDependency("node" + std::to_string(dependency));
+        }
+
+        const std::string value_name = "value" + std::to_string(index);
+
+        switch(payload)
+        {
+        case Payload::Real:
+            registerValueFactory( std::make_shared<RealValueFactory>(value_name) );
+            break;
+        case Payload::SE3:
+            registerValueFactory( std::make_shared<SE3ValueFactory>(value_name) );
+            break;
+        case Payload::Hidden:
+        default:
+            registerValueFactory( std::make_shared< HiddenValueFactory< std::vector<double> > >(value_name) );
+            break;
+        }
+    }
+
+    void getSample(SampleContext& context, const ValueSpan& input, const ValueSpan& output) override
+    {
+        double x = 0.0;
+
+        if(input.size() == 0)
+        {
+            x = context.refRandom().uniform();
+        }
+
+        for(const ValuePtr& value : input)
+        {
+            x += readValue(*value);
+        }
+
+        for(int i=0; i<myWork; i++)
+        {
+            x = x * 0.999999 + 1.0e-6;
+        }
+
+        writeValue(x, *output[0]);
+    }
+
+private:
+
+    static double readValue(const Value& value)
+    {
+        double ret = 0.0;
+
+        if(const RealValue* real = dynamic_cast<const RealValue*>(&value))
+        {
+            ret = real->ref();
+        }
+        else if(const SE3Value* pose = dynamic_cast<const SE3Value*>(&value))
+        {
+            ret = pose->refTranslationX();
+        }
+        else if(const HiddenVector* hidden = dynamic_cast<const HiddenVector*>(&value))
+        {
+            ret = hidden->ref().empty() ? 0.0 : hidden->ref().front();
+        }
+
+        return ret;
+    }
+
+    void writeValue(double x, Value& value)
+    {
+        switch(myPayload)
+        {
+        case Payload::Real:
+            static_cast<RealValue&>(value).ref() = x;
+            break;
+        case Payload::SE3:
+            static_cast<SE3Value&>(value).refTranslationX() = x;
+            static_cast<SE3Value&>(value).refTranslationY() = 2.0 * x;
+            static_cast<SE3Value&>(value).refTranslationZ() = 3.0 * x;
+            break;
+        case Payload::Hidden:
+        default:
+            static_cast<HiddenVector&>(value).ref().assign(8, x);
+            break;
+        }
+    }
+
+private:
+
+    Payload myPayload;
+    int myWork;
+};
+
+static const char* getName(Topology topology)
+{
+    const char* ret = "chain";
+
+    if(topology == Topology::FanIn)
+    {
+        ret = "fanin";
+    }
+    else if(topology == Topology::Diamond)
+    {
+        ret = "diamond";
+    }
+
+    return ret;
+}
+
+static const char* getName(Payload payload)
+{
+    const char* names[] = { "real", "se3", "hidden", "mixed" };
+    return names[int(payload)];
+}
+
+static std::string getName(const Config& config)
+{
+    std::stringstream s;
+
+    s << getName(config.topology) << "/" << config.num_nodes << "/" << (config.expensive ? "expensive" : "cheap") << "/" << getName(config.payload);
+    s << "/" << (config.sink == SinkType::SQLite ? "sqlite" : "null") << "/batch" << config.batch_size << "/" << (config.multithread ? "mt" : "seq");
+
+    return s.str();
+}
+
+static std::vector<NodePtr> createGraph(const Config& config)
+{
+    const int n = config.num_nodes;
+    const int work = config.expensive ? 2000 : 0;
+    std::vector<NodePtr> ret;
+
+    for(int i=0; i<n; i++)
+    {
+        std::vector<int> dependencies;
+
+        if(config.topology == Topology::Chain && i > 0)
+        {
+            dependencies.push_back(i-1);
+        }
+        else if(config.topology == Topology::FanIn && i == n-1)
+        {
+            for(int j=0; j<n-1; j++)
+            {
+                dependencies.push_back(j);
+            }
+        }
+        else if(config.topology == Topology::Diamond && i > 0)
+        {
+            if(i < n-1)
+            {
+                dependencies.push_back(0);
+            }
+            else
+            {
+                for(int j=1; j<n-1; j++)
+                {
+                    dependencies.push_back(j);
+                }
+            }
+        }
+
+        Payload payload = (config.payload == Payload::Mixed) ? Payload(i % 3) : config.payload;
+
+        // the last node, which depends on all the others, exports a field so that no node is dead (see CompiledGraph).
+
+        if(i == n-1 && payload == Payload::Hidden)
+        {
+            payload = Payload::Real;
+        }
+
+        ret.push_back(std::make_shared<BenchNode>(i, dependencies, payload, work));
+    }
+
+    return ret;
+}
+
+static bool runConfig(const Config& config, bool quick, const std::string& directory)
+{
+    // about the same number of node calls for every graph size, and at least a few batches.
+
+    const int node_calls = (quick ? 200000 : 2000000) / (config.expensive ? 200 : 1);
+    const int num_samples = std::max(std::max(20, 4*config.batch_size), node_calls / config.num_nodes);
+    const std::string db_path = directory + "/banesa_bench.sqlite";
+
+    std::vector<NodePtr> graph = createGraph(config);
+    SinkPtr sink;
+
+    if(config.sink == SinkType::SQLite)
+    {
+        std::remove(db_path.c_str());
+
+        std::shared_ptr<SQLiteSink> sqlite_sink = std::make_shared<SQLiteSink>(db_path);
+        sqlite_sink->setBulkLoad(true);
+        sink = sqlite_sink;
+    }
+    else
+    {
+        sink = std::make_shared<NullSink>();
+    }
+
+    Sampler sampler;
+    sampler.setBatchSize(config.batch_size);
+
+    const uint64_t allocations0 = num_allocations.load();
+    const auto t0 = std::chrono::steady_clock::now();
+
+    bool ok = sampler.run(graph, num_samples, sink, config.multithread);
+
+    const auto t1 = std::chrono::steady_clock::now();
+    const uint64_t allocations1 = num_allocations.load();
+
+    const int pipeline_depth = sampler.getPipelineDepth();
+    const size_t peak_memory = sampler.getPeakMemory();
+    const int num_setup_samples = std::min(num_samples/2, std::max(1, pipeline_depth) * config.batch_size);
+
+    const uint64_t setup_allocations0 = num_allocations.load();
+    const auto setup_t0 = std::chrono::steady_clock::now();
+
+    ok = ok && sampler.run(graph, num_setup_samples, sink, config.multithread);
+
+    const auto setup_t1 = std::chrono::steady_clock::now();
+    const uint64_t setup_allocations1 = num_allocations.load();
+
+    const double seconds = std::chrono::duration_cast< std::chrono::duration<double> >(t1 - t0).count();
+    const double setup_run_seconds = std::chrono::duration_cast< std::chrono::duration<double> >(setup_t1 - setup_t0).count();
+    const double setup_run_allocations = double(setup_allocations1 - setup_allocations0);
+
+    const int num_sampling_samples = num_samples - num_setup_samples;
+    const double sample_seconds = std::max(1.0e-12, seconds - setup_run_seconds) / num_sampling_samples;
+    const double sample_allocations = std::max(0.0, double(allocations1 - allocations0) - setup_run_allocations) / num_sampling_samples;
+    const double setup_seconds = std::max(0.0, setup_run_seconds - num_setup_samples*sample_seconds);
+    const double setup_allocations = std::max(0.0, setup_run_allocations - num_setup_samples*sample_allocations);
+
+    std::cout << "{\"name\":\"" << getName(config) << "\"";
+    std::cout << ",\"topology\":\"" << getName(config.topology) << "\"";
+    std::cout << ",\"nodes\":" << config.num_nodes;
+    std::cout << ",\"cost\":\"" << (config.expensive ? "expensive" : "cheap") << "\"";
+    std::cout << ",\"payload\":\"" << getName(config.payload) << "\"";
+    std::cout << ",\"sink\":\"" << (config.sink == SinkType::SQLite ? "sqlite" : "null") << "\"";
+    std::cout << ",\"batch_size\":" << config.batch_size;
+    std::cout << ",\"multithread\":" << (config.multithread ? "true" : "false");
+    std::cout << ",\"ok\":" << (ok ? "true" : "false");
+    std::cout << ",\"samples\":" << num_samples;
+    std::cout << ",\"seconds\":" << seconds;
+    std::cout << ",\"setup_seconds\":" << setup_seconds;
+    std::cout << ",\"setup_allocations\":" << setup_allocations;
+    std::cout << ",\"samples_per_second\":" << 1.0 / sample_seconds;
+    std::cout << ",\"ns_per_node\":" << sample_seconds * 1.0e9 / config.num_nodes;
+    std::cout << ",\"allocations_per_sample\":" << sample_allocations;
+    std::cout << ",\"pipeline_depth\":" << pipeline_depth;
+    std::cout << ",\"peak_memory\":" << peak_memory;
+    std::cout << "}" << std::endl;
+
+    if(config.sink == SinkType::SQLite)
+    {
+        std::remove(db_path.c_str());
+    }
+
+    return ok;
+}
+
+static void getConfigs(std::vector<Config>& configs)
+{
+    const Topology topologies[] = { Topology::Chain, Topology::FanIn, Topology::Diamond };
+    const Payload payloads[] = { Payload::Real, Payload::SE3, Payload::Hidden };
+    const int sizes[] = { 10, 100, 1000, 10000 };
+
+    configs.clear();
+
+    for(bool multithread : {false, true})
+    {
+        // overhead of the engine with respect to the shape and size of the graph.
+
+        for(Topology topology : topologies)
+        {
+            for(int size : sizes)
+            {
+                configs.push_back(Config{topology, size, false, Payload::Mixed, SinkType::Null, 1, multithread});
+            }
+        }
+
+        for(int size : sizes)
+        {
+            configs.push_back(Config{Topology::Chain, size, false, Payload::Mixed, SinkType::Null, 64, multithread});
+        }
+
+        // nodes doing some work.
+
+        for(Topology topology : topologies)
+        {
+            configs.push_back(Config{topology, 10, true, Payload::Mixed, SinkType::Null, 1, multithread});
+            configs.push_back(Config{topology, 100, true, Payload::Mixed, SinkType::Null, 1, multithread});
+        }
+
+        // cost of each type of value.
+
+        for(Payload payload : payloads)
+        {
+            configs.push_back(Config{Topology::Chain, 100, false, payload, SinkType::Null, 1, multithread});
+        }
+
+        // export throughput, SQLite being limited in the number of columns.
+
+        for(Payload payload : payloads)
+        {
+            configs.push_back(Config{Topology::Chain, 10, false, payload, SinkType::SQLite, 1, multithread});
+            configs.push_back(Config{Topology::Chain, 100, false, payload, SinkType::SQLite, 1, multithread});
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    std::string filter;
+    std::string directory = ".";
+    bool ok = true;
+
+    for(int i=1; ok && i<argc; i++)
+    {
+        if(std::strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else if(std::strcmp(argv[i], "--filter") == 0 && i+1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--dir") == 0 && i+1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--filter <substring>] [--dir <directory>]" << std::endl;
+            ok = false;
+        }
+    }
+
+    std::vector<Config> configs;
+    getConfigs(configs);
+
+    for(size_t i=0; ok && i<configs.size(); i++)
+    {
+        if(filter.empty() || getName(configs[i]).find(filter) != std::string::npos)
+        {
+            ok = runConfig(configs[i], quick, directory);
+        }
+    }
+
+    return (ok ? 0 : 1);
+}
@@ -0,0 +1,159 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <banesa.h>
+
+// Compares the SE(3) kernels for each available instruction set with a naive implementation
+// working on one SE3Value at a time, as nodes used to do.
+
+static double measure(int repetitions, size_t size, const std::function<void()>& f)
+{
+    f();
+
+    const auto t0 = std::chrono::steady_clock::now();
+
+    for(int i=0; i<repetitions; i++)
+    {
+        f();
+    }
+
+    const auto t1 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(t1 - t0).count() * 1.0e9 / double(repetitions * size);
+}
+
+static void copyPose(const SE3Value& from, SE3Value& to)
+{
+    to.refTranslationX() = from.refTranslationX();
+    to.refTranslationY() = from.refTranslationY();
+    to.refTranslationZ() = from.refTranslationZ();
+    to.refQuaternionW() = from.refQuaternionW();
+    to.refQuaternionI() = from.refQuaternionI();
+    to.refQuaternionJ() = from.refQuaternionJ();
+    to.refQuaternionK() = from.refQuaternionK();
+}
+
+static void composeNaive(std::vector<ValuePtr>& a, std::vector<ValuePtr>& b, std::vector<ValuePtr>& c)
+{
+    for(size_t i=0; i<a.size(); i++)
+    {
+        SE3Value& x = static_cast<SE3Value&>(*a[i]);
+        SE3Value& y = static_cast<SE3Value&>(*b[i]);
+        SE3Value& z = static_cast<SE3Value&>(*c[i]);
+
+        const double w1 = x.refQuaternionW();
+        const double i1 = x.refQuaternionI();
+        const double j1 = x.refQuaternionJ();
+        const double k1 = x.refQuaternionK();
+        const double w2 = y.refQuaternionW();
+        const double i2 = y.refQuaternionI();
+        const double j2 = y.refQuaternionJ();
+        const double k2 = y.refQuaternionK();
+
+        // rotation matrix of the first quaternion.
+
+        const double r00 = 1.0 - 2.0*(j1*j1 + k1*k1);
+        const double r01 = 2.0*(i1*j1 - w1*k1);
+        const double r02 = 2.0*(i1*k1 + w1*j1);
+        const double r10 = 2.0*(i1*j1 + w1*k1);
+        const double r11 = 1.0 - 2.0*(i1*i1 + k1*k1);
+        const double r12 = 2.0*(j1*k1 - w1*i1);
+        const double r20 = 2.0*(i1*k1 - w1*j1);
+        const double r21 = 2.0*(j1*k1 + w1*i1);
+        const double r22 = 1.0 - 2.0*(i1*i1 + j1*j1);
+
+        const double tx = y.refTranslationX();
+        const double ty = y.refTranslationY();
+        const double tz = y.refTranslationZ();
+
+        z.refTranslationX() = x.refTranslationX() + r00*tx + r01*ty + r02*tz;
+        z.refTranslationY() = x.refTranslationY() + r10*tx + r11*ty + r12*tz;
+        z.refTranslationZ() = x.refTranslationZ() + r20*tx + r21*ty + r22*tz;
+        z.refQuaternionW() = w1*w2 - i1*i2 - j1*j2 - k1*k2;
+        z.refQuaternionI() = w1*i2 + i1*w2 + j1*k2 - k1*j2;
+        z.refQuaternionJ() = w1*j2 - i1*k2 + j1*w2 + k1*i2;
+        z.refQuaternionK() = w1*k2 + i1*j2 - j1*i2 + k1*w2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t size = 4096;
+    const int repetitions = 2000;
+
+    ValueFactoryPtr factory = std::make_shared<SE3ValueFactory>("pose");
+    std::shared_ptr<SE3Column> a = std::static_pointer_cast<SE3Column>(factory->createColumn(size));
+    std::shared_ptr<SE3Column> b = std::static_pointer_cast<SE3Column>(factory->createColumn(size));
+    std::shared_ptr<SE3Column> c = std::static_pointer_cast<SE3Column>(factory->createColumn(size));
+    std::vector<ValuePtr> va(size);
+    std::vector<ValuePtr> vb(size);
+    std::vector<ValuePtr> vc(size);
+    std::vector<double> u1(size);
+    std::vector<double> u2(size);
+    std::vector<double> u3(size);
+    std::vector<double> rotation_error(size);
+    std::vector<double> translation_error(size);
+
+    RandomStream random(0, 0, 0);
+
+    for(size_t i=0; i<size; i++)
+    {
+        u1[i] = random.uniform();
+        u2[i] = random.uniform();
+        u3[i] = random.uniform();
+
+        a->getTranslationX()[i] = random.uniform();
+        a->getTranslationY()[i] = random.uniform();
+        a->getTranslationZ()[i] = random.uniform();
+        b->getTranslationX()[i] = random.uniform();
+        b->getTranslationY()[i] = random.uniform();
+        b->getTranslationZ()[i] = random.uniform();
+    }
+
+    SE3Kernels kernels;
+    kernels.setRandomRotations(u1.data(), u2.data(), u3.data(), SE3Batch(*a, size));
+    kernels.setRandomRotations(u3.data(), u1.data(), u2.data(), SE3Batch(*b, size));
+
+    // independently allocated values, for the naive path.
+
+    for(size_t i=0; i<size; i++)
+    {
+        va[i] = factory->createValue();
+        vb[i] = factory->createValue();
+        vc[i] = factory->createValue();
+
+        copyPose(static_cast<SE3Value&>(*a->refValue(i)), static_cast<SE3Value&>(*va[i]));
+        copyPose(static_cast<SE3Value&>(*b->refValue(i)), static_cast<SE3Value&>(*vb[i]));
+    }
+
+    std::cout << std::setw(10) << "level" << std::setw(12) << "normalize" << std::setw(12) << "compose" << std::setw(12) << "invert" << std::setw(12) << "random" << std::setw(12) << "errors" << "   (ns per transformation)" << std::endl;
+
+    std::cout << std::setw(10) << "naive" << std::setw(12) << "-";
+    std::cout << std::setw(12) << measure(repetitions, size, [&] () { composeNaive(va, vb, vc); });
+    std::cout << std::setw(12) << "-" << std::setw(12) << "-" << std::setw(12) << "-" << std::endl;
+
+    const std::pair<SIMDLevel, const char*> levels[] = { {SIMDLevel::Scalar, "scalar"}, {SIMDLevel::AVX2, "avx2"}, {SIMDLevel::AVX512, "avx512"} };
+
+    for(const auto& level : levels)
+    {
+        if(kernels.setLevel(level.first))
+        {
+            const SE3Batch ba(*a, size);
+            const SE3Batch bb(*b, size);
+            const SE3Batch bc(*c, size);
+
+            std::cout << std::setw(10) << level.second;
+            std::cout << std::setw(12) << measure(repetitions, size, [&] () { kernels.normalize(ba); });
+            std::cout << std::setw(12) << measure(repetitions, size, [&] () { kernels.compose(ba, bb, bc); });
+            std::cout << std::setw(12) << measure(repetitions, size, [&] () { kernels.invert(ba, bc); });
+            std::cout << std::setw(12) << measure(repetitions, size, [&] () { kernels.setRandomRotations(u1.data(), u2.data(), u3.data(), bc); });
+            std::cout << std::setw(12) << measure(repetitions, size, [&] () { kernels.getErrors(ba, bb, rotation_error.data(), translation_error.data()); });
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -3,13 +3,52 @@
 #include <iostream>
 #include "banesa.h"
 
-using RandomEngine = std::default_random_engine;
+// images are saved as binary PPM files by the I/O threads of the sampler.
 
-class ExperimentalConditionsNode : public Node
+template<>
+struct FileValueSerializer<cv::Mat3b>
+{
+    static bool encode(const cv::Mat3b& image, std::vector<char>& buffer)
+    {
+        const std::string header = "P6\n" + std::to_string(image.cols) + " " + std::to_string(image.rows) + "\n255\n";
+
+        buffer.assign(header.begin(), header.end());
+
+        for(int i=0; i<image.rows; i++)
+        {
+            const unsigned char* row = image.ptr(i);
+
+            for(int j=0; j<image.cols; j++)
+            {
+                // BGR to RGB.
+                buffer.push_back(row[3*j+2]);
+                buffer.push_back(row[3*j+1]);
+                buffer.push_back(row[3*j+0]);
+            }
+        }
+
+        return true;
+    }
+};
+
+// lets the sampler account for the pixels held by the samples in flight.
+
+template<>
+struct MemorySize<cv::Mat3b>
+{
+    static size_t get(const cv::Mat3b& image)
+    {
+        return sizeof(cv::Mat3b) + image.total() * image.elemSize();
+    }
+};
+
+using ImageValue = FileValue<cv::Mat3b>;
+
+class ExperimentalConditionsNode : public TypedNode< Inputs<>, Outputs<ImageValue, SE3Value, SE3Value> >
 {
 public:
 
-    ExperimentalConditionsNode(RandomEngine& random) : myRandom(random)
+    ExperimentalConditionsNode()
     {
         setName("experimental_conditions");
         registerValueFactory( std::make_shared< FileValueFactory<cv::Mat3b> >("image") );
@@ -17,66 +56,52 @@ public:
         registerValueFactory( std::make_shared<SE3ValueFactory>("object_to_world") );
     }
 
-    void getSample(const std::vector<ValuePtr>& input, std::vector<ValuePtr>& output) override
+    void getTypedSample(
+        SampleContext& context,
+        ImageValue& output_image,
+        SE3Value& output_camera_to_world,
+        SE3Value& output_object_to_world) override
     {
-        auto output_image = std::dynamic_pointer_cast< FileValue<cv::Mat3b> >(output[0]);
-        auto output_camera_to_world = std::dynamic_pointer_cast<SE3Value>(output[1]);
-        auto output_object_to_world = std::dynamic_pointer_cast<SE3Value>(output[2]);
-
-        assert( output_image );
-        assert( output_camera_to_world );
-        assert( output_object_to_world );
-
-        output_image->setPath("nada.txt");
-        output_image->ref() = cv::Mat3b(320, 200);
-
-        output_camera_to_world->refTranslationX() = 0.0;
-        output_camera_to_world->refTranslationY() = 0.0;
-        output_camera_to_world->refTranslationZ() = 0.0;
-        output_camera_to_world->refQuaternionW() = 1.0;
-        output_camera_to_world->refQuaternionI() = 0.0;
-        output_camera_to_world->refQuaternionJ() = 0.0;
-        output_camera_to_world->refQuaternionK() = 0.0;
-
-        output_object_to_world->refTranslationX() = 0.0;
-        output_object_to_world->refTranslationY() = 0.0;
-        output_object_to_world->refTranslationZ() = 0.0;
-        output_object_to_world->refQuaternionW() = 1.0;
-        output_object_to_world->refQuaternionI() = 0.0;
-        output_object_to_world->refQuaternionJ() = 0.0;
-        output_object_to_world->refQuaternionK() = 0.0;
+        output_image.setPath("image_" + std::to_string(context.getSample()) + ".ppm");
+        output_image.ref() = cv::Mat3b(320, 200);
+
+        output_camera_to_world.refTranslationX() = 0.0;
+        output_camera_to_world.refTranslationY() = 0.0;
+        output_camera_to_world.refTranslationZ() = 0.0;
+        output_camera_to_world.refQuaternionW() = 1.0;
+        output_camera_to_world.refQuaternionI() = 0.0;
+        output_camera_to_world.refQuaternionJ() = 0.0;
+        output_camera_to_world.refQuaternionK() = 0.0;
+
+        output_object_to_world.refTranslationX() = 0.0;
+        output_object_to_world.refTranslationY() = 0.0;
+        output_object_to_world.refTranslationZ() = 0.0;
+        output_object_to_world.refQuaternionW() = 1.0;
+        output_object_to_world.refQuaternionI() = 0.0;
+        output_object_to_world.refQuaternionJ() = 0.0;
+        output_object_to_world.refQuaternionK() = 0.0;
     }
-
-protected:
-
-    RandomEngine myRandom;
 };
 
-class AlgorithmParametersNode : public Node
+class AlgorithmParametersNode : public TypedNode< Inputs<>, Outputs<RealValue> >
 {
 public:
 
-    AlgorithmParametersNode(RandomEngine& random) : myRandom(random)
+    AlgorithmParametersNode()
     {
         setName("algorithm_parameters");
+        setDesignDimensions(1);
         registerValueFactory( std::make_shared<RealValueFactory>("threshold") );
     }
 
-    void getSample(const std::vector<ValuePtr>& input, std::vector<ValuePtr>& output) override
+    // the parameters cover their range according to the design chosen for the sampler.
+    void getTypedSample(SampleContext& context, RealValue& output_threshold) override
     {
-        auto output_threshold = std::dynamic_pointer_cast<RealValue>(output[0]);
-
-        assert( output_threshold );
-
-        output_threshold->ref() = 10.0;
+        output_threshold.ref() = 5.0 + 10.0 * context.getDesignPoint()[0];
     }
-
-protected:
-
-    RandomEngine myRandom;
 };
 
-class PoseEstimationNode : public Node
+class PoseEstimationNode : public TypedNode< Inputs<ImageValue, SE3Value, SE3Value, RealValue>, Outputs<SE3Value> >
 {
 public:
 
@@ -88,34 +113,26 @@ public:
         registerValueFactory( std::make_shared<SE3ValueFactory>("position_est") );
     }
 
-    void getSample(const std::vector<ValuePtr>& input, std::vector<ValuePtr>& output) override
+    void getTypedSample(
+        SampleContext& context,
+        const ImageValue& input_image,
+        const SE3Value& input_camera_to_world,
+        const SE3Value& input_object_to_world,
+        const RealValue& input_threshold,
+        SE3Value& output_object_to_world_est) override
     {
-        auto input_image = std::dynamic_pointer_cast< FileValue<cv::Mat3b> >(input[0]);
-        auto input_camera_to_world = std::dynamic_pointer_cast<SE3Value>(input[1]);
-        auto input_object_to_world = std::dynamic_pointer_cast<SE3Value>(input[2]);
-        auto input_threshold = std::dynamic_pointer_cast<RealValue>(input[3]);
-
-        auto output_object_to_world_est = std::dynamic_pointer_cast<SE3Value>(output[0]);
-
-        assert( input_image );
-        assert( input_camera_to_world );
-        assert( input_object_to_world );
-        assert( input_threshold );
-        assert( output_object_to_world_est );
     }
 };
 
 int main(int num_args, char** args)
 {
-    RandomEngine random;
-
-    auto node0 = std::make_shared<ExperimentalConditionsNode>(random);
-    auto node1 = std::make_shared<AlgorithmParametersNode>(random);
+    auto node0 = std::make_shared<ExperimentalConditionsNode>();
+    auto node1 = std::make_shared<AlgorithmParametersNode>();
     auto node2 = std::make_shared<PoseEstimationNode>();
 
     Sampler sampler;
-    sampler.run({node0, node1, node2}, 10, "db.sqlite", false);
+    const bool ok = sampler.run({node0, node1, node2}, 10, "db.sqlite", false);
 
-    return 0;
+    return (ok ? 0 : 1);
 }
 
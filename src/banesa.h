@@ -4,9 +4,24 @@
 #pragma once
 
 #include "banesa_core.h"
+#include "banesa_typed_node.h"
 #include "banesa_hidden_value.h"
 #include "banesa_file_value.h"
+#include "banesa_packed_file_value.h"
 #include "banesa_primitive_value.h"
+#include "banesa_array_value.h"
 #include "banesa_se3_value.h"
+#include "banesa_se3_kernels.h"
+#include "banesa_sink.h"
+#include "banesa_sqlite_sink.h"
+#include "banesa_sqlite_source.h"
+#include "banesa_columnar_sink.h"
+#include "banesa_memo_cache.h"
+#include "banesa_design.h"
+#include "banesa_run_stats.h"
+#include "banesa_convergence_monitor.h"
+#include "banesa_compiled_graph.h"
+#include "banesa_pack_store.h"
+#include "banesa_payload_writer.h"
 #include "banesa_sampler.h"
 
@@ -0,0 +1,311 @@
+
+#pragma once
+
+#include "banesa_core.h"
+
+// Arrays are stored in a single BLOB field: a 16-byte header followed by the elements in native (little-endian)
+// byte order and row-major order. The header holds the type of the elements, the rank (1 or 2) and the dimensions,
+// unused dimensions being zero. The header size keeps the elements aligned in memory.
+
+enum class ArrayType : uint8_t
+{
+    UInt8,
+    Int32,
+    Int64,
+    Float32,
+    Float64
+};
+
+struct ArrayHeader
+{
+    uint8_t type;
+    uint8_t rank;
+    uint16_t reserved;
+    uint32_t shape[3];
+};
+
+static_assert(sizeof(ArrayHeader) == 16, "Unexpected size of array header!");
+
+template<typename T>
+struct ArrayElement;
+
+template<>
+struct ArrayElement<uint8_t>
+{
+    static const ArrayType type = ArrayType::UInt8;
+};
+
+template<>
+struct ArrayElement<int32_t>
+{
+    static const ArrayType type = ArrayType::Int32;
+};
+
+template<>
+struct ArrayElement<int64_t>
+{
+    static const ArrayType type = ArrayType::Int64;
+};
+
+template<>
+struct ArrayElement<float>
+{
+    static const ArrayType type = ArrayType::Float32;
+};
+
+template<>
+struct ArrayElement<double>
+{
+    static const ArrayType type = ArrayType::Float64;
+};
+
+// Read-only view on an array stored in a BLOB, for example as returned by sqlite3_column_blob(). Nothing is copied,
+// hence the BLOB must outlive the view. Elements are read with memcpy, as the BLOB may not be aligned.
+
+template<typename T>
+class ArrayView
+{
+public:
+
+    ArrayView()
+    {
+        myHeader = ArrayHeader{0, 0, 0, {0, 0, 0}};
+        myData = nullptr;
+        mySize = 0;
+    }
+
+    // Returns false if the BLOB is not an array of T.
+    bool parse(const void* blob, size_t size)
+    {
+        bool ok = (blob != nullptr && size >= sizeof(ArrayHeader));
+
+        if(ok)
+        {
+            std::memcpy(&myHeader, blob, sizeof(ArrayHeader));
+            ok = (myHeader.type == static_cast<uint8_t>(ArrayElement<T>::type) && myHeader.rank >= 1 && myHeader.rank <= 2);
+        }
+
+        if(ok)
+        {
+            mySize = 1;
+
+            for(int i=0; i<myHeader.rank; i++)
+            {
+                mySize *= myHeader.shape[i];
+            }
+
+            myData = static_cast<const char*>(blob) + sizeof(ArrayHeader);
+            ok = (size == sizeof(ArrayHeader) + mySize*sizeof(T));
+        }
+
+        if(ok == false)
+        {
+            myData = nullptr;
+            mySize = 0;
+        }
+
+        return ok;
+    }
+
+    int getRank() const
+    {
+        return myHeader.rank;
+    }
+
+    size_t getDimension(int i) const
+    {
+        return myHeader.shape[i];
+    }
+
+    // number of elements.
+    size_t size() const
+    {
+        return mySize;
+    }
+
+    T operator[](size_t i) const
+    {
+        T ret;
+        std::memcpy(&ret, myData + i*sizeof(T), sizeof(T));
+        return ret;
+    }
+
+    T operator()(size_t i, size_t j) const
+    {
+        return (*this)[i*myHeader.shape[1] + j];
+    }
+
+    void copyTo(T* destination) const
+    {
+        std::memcpy(destination, myData, mySize*sizeof(T));
+    }
+
+private:
+
+    ArrayHeader myHeader;
+    const char* myData;
+    size_t mySize;
+};
+
+// Fixed-size matrix of numbers, stored in a single BLOB field (see ArrayHeader). The header is kept in front of
+// the elements, so that the value is written without being encoded. A matrix with one column is saved as a vector.
+
+template<typename T, int Rows, int Cols=1>
+class MatrixValue : public Value
+{
+public:
+
+    static_assert(Rows > 0 && Cols > 0, "Incorrect dimensions!");
+
+    MatrixValue(ValueFactoryPtr factory) : Value(factory)
+    {
+        myBlob.header.type = static_cast<uint8_t>(ArrayElement<T>::type);
+        myBlob.header.rank = (Cols == 1) ? 1 : 2;
+        myBlob.header.reserved = 0;
+        myBlob.header.shape[0] = Rows;
+        myBlob.header.shape[1] = (Cols == 1) ? 0 : Cols;
+        myBlob.header.shape[2] = 0;
+
+        for(T& x : myBlob.data)
+        {
+            x = T();
+        }
+    }
+
+    MatrixValue(const MatrixValue& other) = delete;
+
+    MatrixValue& operator=(const MatrixValue& other) = delete;
+
+    // elements in row-major order.
+    T* data()
+    {
+        return myBlob.data;
+    }
+
+    const T* data() const
+    {
+        return myBlob.data;
+    }
+
+    T& operator[](int i)
+    {
+        return myBlob.data[i];
+    }
+
+    const T& operator[](int i) const
+    {
+        return myBlob.data[i];
+    }
+
+    T& operator()(int i, int j)
+    {
+        return myBlob.data[i*Cols + j];
+    }
+
+    const T& operator()(int i, int j) const
+    {
+        return myBlob.data[i*Cols + j];
+    }
+
+    void write(FieldWriter& writer, int& offset) override
+    {
+        writer.writeBlob(offset, &myBlob, sizeof(ArrayHeader) + sizeof(myBlob.data));
+        offset++;
+    }
+
+    bool read(FieldReader& reader, int& offset) override
+    {
+        const void* blob = nullptr;
+        size_t size = 0;
+        ArrayView<T> view;
+
+        bool ok = reader.readBlob(offset, blob, size) && view.parse(blob, size);
+
+        ok = ok && (view.getRank() == myBlob.header.rank) && (view.getDimension(0) == myBlob.header.shape[0]) && (view.getDimension(1) == myBlob.header.shape[1]);
+
+        if(ok)
+        {
+            view.copyTo(myBlob.data);
+        }
+
+        offset++;
+
+        return ok;
+    }
+
+    size_t getMemorySize() const override
+    {
+        return sizeof(MatrixValue);
+    }
+
+    bool isComparable() const override
+    {
+        return true;
+    }
+
+    uint64_t getHash() const override
+    {
+        uint64_t ret = 0;
+
+        for(const T& x : myBlob.data)
+        {
+            ret = combineHash(ret, ValueContent<T>::hash(x));
+        }
+
+        return ret;
+    }
+
+    bool isEqual(const Value& other) const override
+    {
+        const T* other_data = static_cast<const MatrixValue&>(other).data();
+        bool ret = true;
+
+        for(int i=0; ret && i<Rows*Cols; i++)
+        {
+            ret = (myBlob.data[i] == other_data[i]);
+        }
+
+        return ret;
+    }
+
+    void assign(const Value& other) override
+    {
+        std::memcpy(myBlob.data, static_cast<const MatrixValue&>(other).data(), sizeof(myBlob.data));
+    }
+
+protected:
+
+    struct Blob
+    {
+        ArrayHeader header;
+        T data[Rows*Cols];
+    };
+
+    Blob myBlob;
+};
+
+template<typename T, int N>
+using VectorValue = MatrixValue<T, N, 1>;
+
+template<typename T, int Rows, int Cols=1>
+class MatrixValueFactory : public ValueFactory
+{
+public:
+
+    MatrixValueFactory(const std::string& name) : ValueFactory(name)
+    {
+    }
+
+    void getFields(std::vector<Field>& fields) override
+    {
+        fields.assign({ Field{getName(), FieldType::Blob} });
+    }
+
+    ValuePtr createValue() override
+    {
+        return std::make_shared< MatrixValue<T, Rows, Cols> >(shared_from_this());
+    }
+};
+
+template<typename T, int N>
+using VectorValueFactory = MatrixValueFactory<T, N, 1>;
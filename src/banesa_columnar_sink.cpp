@@ -0,0 +1,537 @@
+#include <cstring>
+#include <algorithm>
+#include "banesa_columnar_sink.h"
+
+static const char columnar_magic[8] = { 'B', 'N', 'S', 'C', 'O', 'L', '0', '1' };
+
+template<typename T>
+static void writeRaw(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool readRaw(std::istream& stream, T& value)
+{
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(stream);
+}
+
+class ColumnarSink::ColumnBuffer : public FieldWriter
+{
+public:
+
+    ColumnBuffer(const std::vector<Field>& fields) : myFields(fields)
+    {
+        myColumns.resize(fields.size());
+        myNumRows = 0;
+        clear();
+    }
+
+    void beginRow()
+    {
+        myNumRows++;
+    }
+
+    size_t getNumRows()
+    {
+        return myNumRows;
+    }
+
+    void clear()
+    {
+        for(Column& c : myColumns)
+        {
+            c.integers.clear();
+            c.reals.clear();
+            c.offsets.assign({0});
+            c.bytes.clear();
+        }
+
+        myNumRows = 0;
+    }
+
+    void writeInteger(int column, int64_t value) override
+    {
+        myColumns[column].integers.push_back(value);
+    }
+
+    void writeReal(int column, double value) override
+    {
+        myColumns[column].reals.push_back(value);
+    }
+
+    void writeText(int column, const std::string& value) override
+    {
+        Column& c = myColumns[column];
+        c.bytes.append(value);
+        c.offsets.push_back(c.bytes.size());
+    }
+
+    void writeBlob(int column, const void* data, size_t size) override
+    {
+        Column& c = myColumns[column];
+        c.bytes.append(static_cast<const char*>(data), size);
+        c.offsets.push_back(c.bytes.size());
+    }
+
+    void save(std::ostream& stream, size_t column, uint64_t& size)
+    {
+        Column& c = myColumns[column];
+
+        switch(myFields[column].type)
+        {
+        case FieldType::Integer:
+            size = c.integers.size() * sizeof(int64_t);
+            stream.write(reinterpret_cast<const char*>(c.integers.data()), size);
+            break;
+        case FieldType::Real:
+            size = c.reals.size() * sizeof(double);
+            stream.write(reinterpret_cast<const char*>(c.reals.data()), size);
+            break;
+        case FieldType::Text:
+        case FieldType::Blob:
+            size = c.offsets.size() * sizeof(uint64_t) + c.bytes.size();
+            stream.write(reinterpret_cast<const char*>(c.offsets.data()), c.offsets.size() * sizeof(uint64_t));
+            stream.write(c.bytes.data(), c.bytes.size());
+            break;
+        }
+    }
+
+protected:
+
+    struct Column
+    {
+        std::vector<int64_t> integers;
+        std::vector<double> reals;
+        std::vector<uint64_t> offsets;
+        std::string bytes;
+    };
+
+    const std::vector<Field>& myFields;
+    std::vector<Column> myColumns;
+    size_t myNumRows;
+};
+
+ColumnarSink::ColumnarSink(const std::string& path, size_t rows_per_chunk)
+{
+    myPath = path;
+    myRowsPerChunk = std::max<size_t>(1, rows_per_chunk);
+    myAppend = false;
+}
+
+ColumnarSink::~ColumnarSink()
+{
+}
+
+void ColumnarSink::setAppend(bool append)
+{
+    myAppend = append;
+}
+
+bool ColumnarSink::open(const std::vector<Field>& fields)
+{
+    bool ok = true;
+    bool resume = false;
+    uint64_t footer_offset = 0;
+
+    myFields.assign({ Field{"id", FieldType::Integer} });
+    myFields.insert(myFields.end(), fields.begin(), fields.end());
+
+    myChunks.clear();
+    myStoredSamples.clear();
+    myColumnBuffer.reset(new ColumnBuffer(myFields));
+
+    // an existing file is resumed, unless it cannot be read or its fields differ.
+
+    if(myAppend)
+    {
+        resume = std::ifstream(myPath, std::ios::binary).is_open();
+    }
+
+    if(resume)
+    {
+        ColumnarReader reader;
+        std::vector<int64_t> ids;
+
+        ok = reader.open(myPath) && reader.readIntegerColumn("id", ids);
+
+        for(size_t i=0; ok && i<myFields.size(); i++)
+        {
+            ok = (reader.refFields().size() == myFields.size() && reader.refFields()[i].name == myFields[i].name && reader.refFields()[i].type == myFields[i].type);
+        }
+
+        if(ok)
+        {
+            for(const ColumnarReader::ChunkInfo& chunk : reader.myChunks)
+            {
+                myChunks.push_back(ChunkInfo{chunk.num_rows, chunk.offsets, chunk.sizes});
+            }
+
+            myStoredSamples.assign(ids.begin(), ids.end());
+            footer_offset = reader.myFooterOffset;
+        }
+    }
+
+    // the new footer is at least as large as the previous one, which it overwrites completely.
+
+    if(ok && resume)
+    {
+        myFile.open(myPath, std::ios::binary | std::ios::in | std::ios::out);
+        myFile.seekp(footer_offset);
+        ok = bool(myFile);
+    }
+
+    if(ok && resume == false)
+    {
+        myFile.open(myPath, std::ios::binary | std::ios::trunc);
+
+        myFile.write(columnar_magic, sizeof(columnar_magic));
+        writeRaw<uint32_t>(myFile, myFields.size());
+
+        for(const Field& field : myFields)
+        {
+            writeRaw<uint8_t>(myFile, static_cast<uint8_t>(field.type));
+            writeRaw<uint32_t>(myFile, field.name.size());
+            myFile.write(field.name.data(), field.name.size());
+        }
+
+        ok = bool(myFile);
+    }
+
+    return ok;
+}
+
+bool ColumnarSink::write(int sample, const std::vector<ValuePtr>& values)
+{
+    bool ok = true;
+
+    myColumnBuffer->beginRow();
+    myColumnBuffer->writeInteger(0, sample);
+
+    int field_offset = 1;
+
+    for(const ValuePtr& v : values)
+    {
+        v->write(*myColumnBuffer, field_offset);
+    }
+
+    if(myColumnBuffer->getNumRows() >= myRowsPerChunk)
+    {
+        ok = flushChunk();
+    }
+
+    return ok;
+}
+
+bool ColumnarSink::close()
+{
+    bool ok = flushChunk();
+
+    if(ok)
+    {
+        const uint64_t footer_offset = myFile.tellp();
+
+        writeRaw<uint64_t>(myFile, myChunks.size());
+
+        for(const ChunkInfo& chunk : myChunks)
+        {
+            writeRaw<uint64_t>(myFile, chunk.num_rows);
+
+            for(size_t i=0; i<myFields.size(); i++)
+            {
+                writeRaw<uint64_t>(myFile, chunk.offsets[i]);
+                writeRaw<uint64_t>(myFile, chunk.sizes[i]);
+            }
+        }
+
+        writeRaw<uint64_t>(myFile, footer_offset);
+        myFile.write(columnar_magic, sizeof(columnar_magic));
+
+        myFile.close();
+        ok = bool(myFile);
+    }
+
+    return ok;
+}
+
+bool ColumnarSink::getStoredSamples(std::vector<int>& samples)
+{
+    samples = myStoredSamples;
+    std::sort(samples.begin(), samples.end());
+
+    return true;
+}
+
+bool ColumnarSink::flushChunk()
+{
+    const size_t num_rows = myColumnBuffer->getNumRows();
+
+    if(num_rows > 0)
+    {
+        ChunkInfo chunk;
+        chunk.num_rows = num_rows;
+        chunk.offsets.resize(myFields.size());
+        chunk.sizes.resize(myFields.size());
+
+        for(size_t i=0; i<myFields.size(); i++)
+        {
+            chunk.offsets[i] = myFile.tellp();
+            myColumnBuffer->save(myFile, i, chunk.sizes[i]);
+        }
+
+        myChunks.push_back(std::move(chunk));
+        myColumnBuffer->clear();
+    }
+
+    return bool(myFile);
+}
+
+bool ColumnarReader::open(const std::string& path)
+{
+    bool ok = true;
+    char magic[sizeof(columnar_magic)];
+    uint64_t footer_offset = 0;
+    uint32_t num_columns = 0;
+    uint64_t num_chunks = 0;
+
+    myFields.clear();
+    myChunks.clear();
+    myFooterOffset = 0;
+
+    myFile.open(path, std::ios::binary);
+    ok = bool(myFile);
+
+    if(ok)
+    {
+        myFile.read(magic, sizeof(magic));
+        ok = bool(myFile) && (std::memcmp(magic, columnar_magic, sizeof(magic)) == 0);
+    }
+
+    ok = ok && readRaw(myFile, num_columns);
+
+    for(uint32_t i=0; ok && i<num_columns; i++)
+    {
+        uint8_t type = 0;
+        uint32_t name_size = 0;
+
+        ok = readRaw(myFile, type) && readRaw(myFile, name_size) && type <= static_cast<uint8_t>(FieldType::Blob);
+
+        if(ok)
+        {
+            Field field;
+            field.type = static_cast<FieldType>(type);
+            field.name.resize(name_size);
+            myFile.read(&field.name[0], name_size);
+            ok = bool(myFile);
+            myFields.push_back(std::move(field));
+        }
+    }
+
+    if(ok)
+    {
+        myFile.seekg(-int(sizeof(uint64_t) + sizeof(columnar_magic)), std::ios::end);
+        ok = readRaw(myFile, footer_offset);
+    }
+
+    if(ok)
+    {
+        myFile.read(magic, sizeof(magic));
+        ok = bool(myFile) && (std::memcmp(magic, columnar_magic, sizeof(magic)) == 0);
+    }
+
+    if(ok)
+    {
+        myFile.seekg(footer_offset);
+        ok = readRaw(myFile, num_chunks);
+    }
+
+    for(uint64_t i=0; ok && i<num_chunks; i++)
+    {
+        ChunkInfo chunk;
+        chunk.offsets.resize(myFields.size());
+        chunk.sizes.resize(myFields.size());
+
+        ok = readRaw(myFile, chunk.num_rows);
+
+        for(size_t j=0; ok && j<myFields.size(); j++)
+        {
+            ok = readRaw(myFile, chunk.offsets[j]) && readRaw(myFile, chunk.sizes[j]);
+        }
+
+        // the blocks must lie before the footer and have the size given by their number of rows.
+
+        for(size_t j=0; ok && j<myFields.size(); j++)
+        {
+            const bool fixed_size = (myFields[j].type == FieldType::Integer || myFields[j].type == FieldType::Real);
+
+            ok = (chunk.offsets[j] <= footer_offset && chunk.sizes[j] <= footer_offset - chunk.offsets[j]);
+
+            if(ok && fixed_size)
+            {
+                ok = (chunk.num_rows <= chunk.sizes[j] / 8 && chunk.sizes[j] == chunk.num_rows * 8);
+            }
+            else if(ok)
+            {
+                ok = (chunk.num_rows < chunk.sizes[j] / 8);
+            }
+        }
+
+        myChunks.push_back(std::move(chunk));
+    }
+
+    if(ok)
+    {
+        myFooterOffset = footer_offset;
+    }
+
+    return ok;
+}
+
+size_t ColumnarReader::getNumRows()
+{
+    size_t ret = 0;
+
+    for(const ChunkInfo& chunk : myChunks)
+    {
+        ret += chunk.num_rows;
+    }
+
+    return ret;
+}
+
+bool ColumnarReader::readIntegerColumn(const std::string& name, std::vector<int64_t>& values)
+{
+    size_t column = 0;
+    bool ok = findColumn(name, FieldType::Integer, column);
+
+    values.clear();
+
+    for(size_t i=0; ok && i<myChunks.size(); i++)
+    {
+        const size_t first = values.size();
+        values.resize(first + myChunks[i].num_rows);
+
+        myFile.seekg(myChunks[i].offsets[column]);
+        myFile.read(reinterpret_cast<char*>(values.data() + first), myChunks[i].num_rows * sizeof(int64_t));
+        ok = bool(myFile);
+    }
+
+    return ok;
+}
+
+bool ColumnarReader::readRealColumn(const std::string& name, std::vector<double>& values)
+{
+    size_t column = 0;
+    bool ok = findColumn(name, FieldType::Real, column);
+
+    values.clear();
+
+    for(size_t i=0; ok && i<myChunks.size(); i++)
+    {
+        const size_t first = values.size();
+        values.resize(first + myChunks[i].num_rows);
+
+        myFile.seekg(myChunks[i].offsets[column]);
+        myFile.read(reinterpret_cast<char*>(values.data() + first), myChunks[i].num_rows * sizeof(double));
+        ok = bool(myFile);
+    }
+
+    return ok;
+}
+
+bool ColumnarReader::readTextColumn(const std::string& name, std::vector<std::string>& values)
+{
+    size_t column = 0;
+    bool ok = findColumn(name, FieldType::Text, column);
+    std::vector<uint64_t> offsets;
+    std::string bytes;
+
+    values.clear();
+
+    for(size_t i=0; ok && i<myChunks.size(); i++)
+    {
+        const uint64_t num_rows = myChunks[i].num_rows;
+        const uint64_t offsets_size = (num_rows+1) * sizeof(uint64_t);
+
+        ok = (myChunks[i].sizes[column] >= offsets_size);
+
+        if(ok)
+        {
+            offsets.resize(num_rows+1);
+            bytes.resize(myChunks[i].sizes[column] - offsets_size);
+
+            myFile.seekg(myChunks[i].offsets[column]);
+            myFile.read(reinterpret_cast<char*>(offsets.data()), offsets_size);
+            myFile.read(&bytes[0], bytes.size());
+            ok = bool(myFile) && offsets.back() == bytes.size();
+        }
+
+        for(uint64_t j=0; ok && j<num_rows; j++)
+        {
+            values.push_back(bytes.substr(offsets[j], offsets[j+1] - offsets[j]));
+        }
+    }
+
+    return ok;
+}
+
+bool ColumnarReader::readBlobColumn(const std::string& name, std::vector<char>& bytes, std::vector<uint64_t>& offsets)
+{
+    size_t column = 0;
+    bool ok = findColumn(name, FieldType::Blob, column);
+    std::vector<uint64_t> chunk_offsets;
+
+    bytes.clear();
+    offsets.assign({0});
+
+    for(size_t i=0; ok && i<myChunks.size(); i++)
+    {
+        const uint64_t num_rows = myChunks[i].num_rows;
+        const uint64_t offsets_size = (num_rows+1) * sizeof(uint64_t);
+        const size_t first = bytes.size();
+
+        ok = (myChunks[i].sizes[column] >= offsets_size);
+
+        if(ok)
+        {
+            chunk_offsets.resize(num_rows+1);
+            bytes.resize(first + myChunks[i].sizes[column] - offsets_size);
+
+            myFile.seekg(myChunks[i].offsets[column]);
+            myFile.read(reinterpret_cast<char*>(chunk_offsets.data()), offsets_size);
+            myFile.read(bytes.data() + first, bytes.size() - first);
+            ok = bool(myFile) && chunk_offsets.back() == bytes.size() - first;
+        }
+
+        for(uint64_t j=1; ok && j<=num_rows; j++)
+        {
+            offsets.push_back(first + chunk_offsets[j]);
+        }
+    }
+
+    return ok;
+}
+
+void ColumnarReader::close()
+{
+    myFile.close();
+    myFields.clear();
+    myChunks.clear();
+}
+
+bool ColumnarReader::findColumn(const std::string& name, FieldType type, size_t& column)
+{
+    bool ret = false;
+
+    for(size_t i=0; ret == false && i<myFields.size(); i++)
+    {
+        if(myFields[i].name == name && myFields[i].type == type)
+        {
+            column = i;
+            ret = true;
+        }
+    }
+
+    return ret;
+}
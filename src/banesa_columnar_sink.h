@@ -0,0 +1,117 @@
+
+#pragma once
+
+#include <fstream>
+#include "banesa_sink.h"
+
+// Chunked columnar binary format. All numbers are stored in native (little-endian) byte order.
+//
+// header  : magic "BNSCOL01", uint32 number of columns, then for each column:
+//           uint8 type (0=integer, 1=real, 2=text, 3=blob), uint32 name length, name.
+// chunks  : for each chunk, one contiguous block per column:
+//           integer: int64[num_rows]
+//           real   : double[num_rows]
+//           text   : uint64 offsets[num_rows+1] followed by the concatenated strings.
+//           blob   : same as text.
+// footer  : uint64 number of chunks, then for each chunk:
+//           uint64 num_rows, then for each column uint64 offset and uint64 size of its block.
+// trailer : uint64 offset of the footer, magic "BNSCOL01".
+//
+// The first column is always the sample id. A reader only needs to seek to the blocks of the
+// columns it is interested in.
+//
+// In append mode, the chunks of an existing file are kept and the new chunks are written in place of its footer,
+// hence the file is only readable again once the sink is closed.
+
+class ColumnarSink : public Sink
+{
+public:
+
+    ColumnarSink(const std::string& path, size_t rows_per_chunk=65536);
+
+    ~ColumnarSink() override;
+
+    // In append mode, the samples of an existing file are kept if its fields match, and reported as stored. False by default.
+    void setAppend(bool append);
+
+    bool open(const std::vector<Field>& fields) override;
+
+    bool write(int sample, const std::vector<ValuePtr>& values) override;
+
+    bool getStoredSamples(std::vector<int>& samples) override;
+
+    bool close() override;
+
+private:
+
+    class ColumnBuffer;
+
+    struct ChunkInfo
+    {
+        uint64_t num_rows;
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> sizes;
+    };
+
+private:
+
+    bool flushChunk();
+
+private:
+
+    std::string myPath;
+    size_t myRowsPerChunk;
+    bool myAppend;
+    std::vector<Field> myFields;
+    std::vector<int> myStoredSamples;
+    std::ofstream myFile;
+    std::unique_ptr<ColumnBuffer> myColumnBuffer;
+    std::vector<ChunkInfo> myChunks;
+};
+
+class ColumnarReader
+{
+public:
+
+    bool open(const std::string& path);
+
+    const std::vector<Field>& refFields()
+    {
+        return myFields;
+    }
+
+    size_t getNumRows();
+
+    bool readIntegerColumn(const std::string& name, std::vector<int64_t>& values);
+    bool readRealColumn(const std::string& name, std::vector<double>& values);
+    bool readTextColumn(const std::string& name, std::vector<std::string>& values);
+
+    // The BLOBs of all the rows are concatenated, row i spanning bytes [offsets[i], offsets[i+1]).
+    // Arrays can then be decoded in place with ArrayView.
+    bool readBlobColumn(const std::string& name, std::vector<char>& bytes, std::vector<uint64_t>& offsets);
+
+    void close();
+
+private:
+
+    friend class ColumnarSink;
+
+    struct ChunkInfo
+    {
+        uint64_t num_rows;
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> sizes;
+    };
+
+private:
+
+    bool findColumn(const std::string& name, FieldType type, size_t& column);
+
+private:
+
+    std::ifstream myFile;
+    std::vector<Field> myFields;
+    std::vector<ChunkInfo> myChunks;
+    uint64_t myFooterOffset;
+};
+
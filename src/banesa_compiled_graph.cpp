@@ -0,0 +1,946 @@
+#include <stack>
+#include <set>
+#include <map>
+#include <tbb/task_group.h>
+#include "banesa_compiled_graph.h"
+#include "banesa_primitive_value.h"
+
+class CompiledGraph::ParallelExecution
+{
+public:
+
+    ParallelExecution(CompiledGraph* graph, uint64_t seed, SampleBatch* batch)
+    {
+        myGraph = graph;
+        mySeed = seed;
+        myBatch = batch;
+    }
+
+    void run()
+    {
+        for(size_t i=0; i<myGraph->mySteps.size(); i++)
+        {
+            myBatch->pending_parents[i] = myGraph->mySteps[i].num_parents;
+        }
+
+        for(size_t i : myGraph->myRootSteps)
+        {
+            myGroup.run([this,i] () { runStep(i); });
+        }
+
+        myGroup.wait();
+    }
+
+protected:
+
+    void runStep(size_t index)
+    {
+        while(true)
+        {
+            const Step& step = myGraph->mySteps[index];
+
+            myGraph->runStep(step, mySeed, *myBatch);
+
+            // spawn the children which are ready, except one which is run by the current task.
+
+            bool has_next = false;
+            size_t next = 0;
+
+            for(size_t i=step.children_begin; i<step.children_end; i++)
+            {
+                const size_t child = myGraph->myChildren[i];
+
+                if(--myBatch->pending_parents[child] == 0)
+                {
+                    if(has_next)
+                    {
+                        myGroup.run([this,child] () { runStep(child); });
+                    }
+                    else
+                    {
+                        has_next = true;
+                        next = child;
+                    }
+                }
+            }
+
+            if(has_next == false)
+            {
+                break;
+            }
+
+            index = next;
+        }
+    }
+
+protected:
+
+    CompiledGraph* myGraph;
+    uint64_t mySeed;
+    SampleBatch* myBatch;
+    tbb::task_group myGroup;
+};
+
+// Column of a downstream batch whose values are the shared upstream values of the records, by reference.
+
+class CompiledGraph::SharedColumn : public ValueColumn
+{
+public:
+
+    SharedColumn(std::vector<ValuePtr> values) : ValueColumn(std::move(values))
+    {
+    }
+
+    void setValue(size_t index, const ValuePtr& value)
+    {
+        myValues[index] = value;
+    }
+};
+
+CompiledGraph::CompiledGraph()
+{
+    myRunStats = nullptr;
+    myMultiplicity = 1;
+    myNumDeadNodes = 0;
+    myNumMemoizedSteps = 0;
+    myUpstreamIdIndex = 0;
+    myDesignDimensions = 0;
+    mySource = nullptr;
+}
+
+bool CompiledGraph::build(const std::vector<NodePtr>& graph)
+{
+    bool ok = true;
+    std::map<std::string, size_t> offset;
+    std::set<uint32_t> ids;
+
+    myOrderedNodes.clear();
+    myValueFactories.clear();
+    myFields.clear();
+    myFieldOffsets.clear();
+    myPayloadValues.clear();
+    mySteps.clear();
+    myInputIndices.clear();
+    myChildren.clear();
+    myRootSteps.clear();
+    myMultiplicity = 1;
+    myNumDeadNodes = 0;
+    myNumMemoizedSteps = 0;
+    myUpstreamIdIndex = 0;
+    myInputSlots.clear();
+    mySharedValues.clear();
+    myCopiedValues.clear();
+    myDesignDimensions = 0;
+    myDesign.reset();
+    myUpstreamDesign.reset();
+    mySource = nullptr;
+
+    // compute the layout of a record.
+
+    if(ok)
+    {
+        std::vector<Field> local_fields;
+
+        for(const NodePtr& n : graph)
+        {
+            offset[n->getName()] = myValueFactories.size();
+            ids.insert(n->getId());
+
+            for(const ValueFactoryPtr& vf : n->refValueFactories())
+            {
+                if(vf->hasPayload())
+                {
+                    myPayloadValues.push_back(myValueFactories.size());
+                }
+
+                myValueFactories.push_back(vf);
+                myFieldOffsets.push_back(myFields.size());
+
+                vf->getFields(local_fields);
+                myFields.insert(myFields.end(), local_fields.begin(), local_fields.end());
+            }
+        }
+    }
+
+    // nodes must have distinct names, and distinct identifiers so that their random streams differ.
+
+    if(ok)
+    {
+        ok = (offset.size() == graph.size() && ids.size() == graph.size());
+    }
+
+    // all the fan-out nodes must have the same multiplicity.
+
+    for(size_t i=0; ok && i<graph.size(); i++)
+    {
+        const int multiplicity = graph[i]->getMultiplicity();
+
+        ok = (multiplicity >= 1 && (multiplicity == 1 || myMultiplicity == 1 || multiplicity == myMultiplicity));
+
+        myMultiplicity = std::max(myMultiplicity, multiplicity);
+    }
+
+    // with fan-out, each row is linked to its upstream sample by an extra value which no node computes.
+
+    if(ok && myMultiplicity > 1)
+    {
+        ValueFactoryPtr vf = std::make_shared<IntegerValueFactory>("upstream_id");
+        std::vector<Field> local_fields;
+
+        myUpstreamIdIndex = myValueFactories.size();
+        myValueFactories.push_back(vf);
+        myFieldOffsets.push_back(myFields.size());
+
+        vf->getFields(local_fields);
+        myFields.insert(myFields.end(), local_fields.begin(), local_fields.end());
+    }
+
+    if(ok)
+    {
+        myFieldOffsets.push_back(myFields.size());
+    }
+
+    // compute in which order to process the nodes.
+
+    if(ok)
+    {
+        ok = reorderNodes(graph, myOrderedNodes);
+    }
+
+    // compute the indices of the inputs and outputs of each node.
+
+    if(ok)
+    {
+        std::map<std::string, NodePtr> node_map;
+
+        for(const NodePtr& n : graph)
+        {
+            node_map[n->getName()] = n;
+        }
+
+        for(const NodePtr& node : myOrderedNodes)
+        {
+            Step step;
+            step.node = node.get();
+            step.id = node->getId();
+            step.input_begin = myInputIndices.size();
+
+            for(const std::string& other_node_name : node->refDependencies())
+            {
+                const size_t other_offset = offset[other_node_name];
+                const size_t other_size = node_map[other_node_name]->refValueFactories().size();
+
+                for(size_t i=0; i<other_size; i++)
+                {
+                    myInputIndices.push_back(other_offset + i);
+                }
+            }
+
+            step.input_end = myInputIndices.size();
+            step.output_begin = offset[node->getName()];
+            step.output_end = step.output_begin + node->refValueFactories().size();
+            step.design_begin = 0;
+            step.design_end = 0;
+            step.children_begin = 0;
+            step.children_end = 0;
+            step.num_parents = 0;
+            step.memoized = false;
+            step.memo_slot = 0;
+            step.shared = false;
+            step.live = true;
+            step.loaded = false;
+            step.skipped = false;
+
+            mySteps.push_back(step);
+        }
+    }
+
+    // compute the children of each step, for parallel execution.
+
+    if(ok)
+    {
+        std::map<std::string, size_t> step_index;
+        std::vector< std::vector<size_t> > children(mySteps.size());
+
+        for(size_t i=0; i<myOrderedNodes.size(); i++)
+        {
+            step_index[myOrderedNodes[i]->getName()] = i;
+        }
+
+        for(size_t i=0; i<myOrderedNodes.size(); i++)
+        {
+            std::set<size_t> parents;
+
+            for(const std::string& other_node_name : myOrderedNodes[i]->refDependencies())
+            {
+                parents.insert(step_index[other_node_name]);
+            }
+
+            for(size_t parent : parents)
+            {
+                children[parent].push_back(i);
+            }
+
+            mySteps[i].num_parents = parents.size();
+
+            if(parents.empty())
+            {
+                myRootSteps.push_back(i);
+            }
+
+            // steps are in topological order, hence the parents are already classified.
+
+            if(myMultiplicity > 1)
+            {
+                mySteps[i].shared = (myOrderedNodes[i]->getMultiplicity() == 1);
+
+                for(size_t parent : parents)
+                {
+                    mySteps[i].shared = mySteps[i].shared && mySteps[parent].shared;
+                }
+            }
+        }
+
+        for(size_t i=0; i<mySteps.size(); i++)
+        {
+            mySteps[i].children_begin = myChildren.size();
+            myChildren.insert(myChildren.end(), children[i].begin(), children[i].end());
+            mySteps[i].children_end = myChildren.size();
+        }
+    }
+
+    // dead-node elimination. Children are classified before their parents.
+
+    for(size_t k=mySteps.size(); ok && k>0; k--)
+    {
+        Step& step = mySteps[k-1];
+
+        step.live = step.node->hasSideEffects() || (step.output_end == step.output_begin) || (myFieldOffsets[step.output_end] > myFieldOffsets[step.output_begin]);
+
+        for(size_t c=step.children_begin; step.live == false && c<step.children_end; c++)
+        {
+            step.live = mySteps[ myChildren[c] ].live;
+        }
+
+        step.skipped = (step.live == false);
+
+        if(step.skipped)
+        {
+            myNumDeadNodes++;
+        }
+    }
+
+    // design dimensions are only given to live steps, so that a dead branch does not change the design of the others.
+
+    for(size_t i=0; ok && i<mySteps.size(); i++)
+    {
+        Step& step = mySteps[i];
+
+        step.design_begin = myDesignDimensions;
+        step.design_end = step.design_begin + ((step.live) ? std::max(0, step.node->getDesignDimensions()) : 0);
+
+        myDesignDimensions = int(step.design_end);
+    }
+
+    // shared values are made visible to the downstream records by copy if they are comparable, and by reference otherwise,
+    // in which case the downstream columns are views on the upstream values so that batch nodes see them too.
+
+    if(ok)
+    {
+        myInputSlots.resize(myValueFactories.size());
+        mySharedValues.resize(myValueFactories.size(), false);
+        myCopiedValues.resize(myValueFactories.size(), false);
+
+        for(const Step& step : mySteps)
+        {
+            for(size_t j=step.output_begin; step.shared && j<step.output_end; j++)
+            {
+                mySharedValues[j] = true;
+            }
+        }
+
+        for(size_t k=0; k<myInputIndices.size(); k++)
+        {
+            myInputSlots[ myInputIndices[k] ].push_back(k);
+        }
+    }
+
+    // check that each node is connected to values of the expected types,
+    // and memoize the pure nodes whose values are all comparable.
+
+    if(ok)
+    {
+        SampleBatch batch;
+
+        createBatch(batch, 1);
+
+        const SampleRecord& record = batch.records.front();
+
+        for(size_t i=0; i<record.values.size(); i++)
+        {
+            myCopiedValues[i] = record.values[i]->isComparable();
+        }
+
+        for(size_t i=0; ok && i<mySteps.size(); i++)
+        {
+            Step& step = mySteps[i];
+
+            const ValueSpan input(record.inputs.data() + step.input_begin, step.input_end - step.input_begin);
+            const ValueSpan output(record.values.data() + step.output_begin, step.output_end - step.output_begin);
+
+            ok = step.node->checkValues(input, output);
+
+            step.memoized = step.node->isPure() && (step.design_end == step.design_begin);
+
+            for(const ValuePtr& value : input)
+            {
+                step.memoized = step.memoized && value->isComparable();
+            }
+
+            for(const ValuePtr& value : output)
+            {
+                step.memoized = step.memoized && value->isComparable();
+            }
+
+            if(step.memoized)
+            {
+                step.memo_slot = myNumMemoizedSteps;
+                myNumMemoizedSteps++;
+            }
+        }
+    }
+
+    return ok;
+}
+
+bool CompiledGraph::setDesign(DesignType type, int num_samples, uint64_t seed)
+{
+    const bool ok = (myDesignDimensions <= Design::getMaximumDimensions(type));
+
+    myDesign.reset();
+    myUpstreamDesign.reset();
+
+    if(ok && myDesignDimensions > 0)
+    {
+        myDesign = std::make_shared<Design>(type, myDesignDimensions, num_samples, seed);
+
+        if(myMultiplicity > 1)
+        {
+            myUpstreamDesign = std::make_shared<Design>(type, myDesignDimensions, (num_samples + myMultiplicity - 1) / myMultiplicity, seed);
+        }
+    }
+
+    return ok;
+}
+
+bool CompiledGraph::setSource(SampleSource* source, const std::vector<std::string>& changed_nodes, int probe_sample)
+{
+    bool ok = true;
+    std::vector<bool> changed(mySteps.size(), false);
+    std::vector<bool> readable(mySteps.size(), true);
+
+    mySource = source;
+
+    for(Step& step : mySteps)
+    {
+        step.loaded = false;
+        step.skipped = (step.live == false);
+    }
+
+    // the changed nodes and their descendants are computed. Steps are in topological order.
+
+    for(const std::string& name : changed_nodes)
+    {
+        size_t i = 0;
+
+        while(i < myOrderedNodes.size() && myOrderedNodes[i]->getName() != name)
+        {
+            i++;
+        }
+
+        ok = ok && (i < mySteps.size());
+
+        if(ok)
+        {
+            changed[i] = true;
+        }
+    }
+
+    for(size_t i=0; ok && i<mySteps.size(); i++)
+    {
+        for(size_t k=mySteps[i].children_begin; changed[i] && k<mySteps[i].children_end; k++)
+        {
+            changed[ myChildren[k] ] = true;
+        }
+    }
+
+    // find which values can be read back.
+
+    if(ok && source != nullptr)
+    {
+        SampleBatch batch;
+
+        createBatch(batch, 1);
+
+        SampleRecord& record = batch.records.front();
+
+        ok = source->read(probe_sample, [this,&record,&readable] (FieldReader& reader)
+        {
+            for(size_t i=0; i<mySteps.size(); i++)
+            {
+                for(size_t j=mySteps[i].output_begin; j<mySteps[i].output_end; j++)
+                {
+                    int offset = int(myFieldOffsets[j]);
+                    readable[i] = record.values[j]->read(reader, offset) && readable[i];
+                }
+            }
+
+            return true;
+        });
+    }
+
+    // children are classified before their parents. A step is needed if it has fields to export or a computed child,
+    // and is read if possible, computed otherwise.
+
+    for(size_t k=mySteps.size(); ok && source != nullptr && k>0; k--)
+    {
+        Step& step = mySteps[k-1];
+        bool needed = (myFieldOffsets[step.output_end] > myFieldOffsets[step.output_begin]);
+
+        for(size_t c=step.children_begin; c<step.children_end; c++)
+        {
+            const Step& child = mySteps[ myChildren[c] ];
+            needed = needed || (child.loaded == false && child.skipped == false);
+        }
+
+        if(step.live && changed[k-1] == false)
+        {
+            step.skipped = (needed == false);
+            step.loaded = needed && readable[k-1];
+        }
+    }
+
+    return ok;
+}
+
+void CompiledGraph::createBatch(SampleBatch& batch, size_t capacity)
+{
+    createRecords(batch.columns, batch.input_columns, batch.records, capacity, true);
+
+    // a batch has at most one upstream sample per record.
+
+    if(myMultiplicity > 1)
+    {
+        createRecords(batch.upstream_columns, batch.upstream_input_columns, batch.upstream_records, capacity, false);
+    }
+    else
+    {
+        createRecords(batch.upstream_columns, batch.upstream_input_columns, batch.upstream_records, 0, false);
+    }
+
+    batch.groups.assign(capacity, 0);
+
+    if(myMemoCache)
+    {
+        batch.memo_keys.assign(myNumMemoizedSteps * capacity, 0);
+        batch.memo_missed.assign(myNumMemoizedSteps * capacity, 0);
+    }
+
+    batch.upstream_size = 0;
+    batch.size = 0;
+    batch.sequence = 0;
+    batch.failed = false;
+    batch.memory_size = 0;
+    batch.pending_parents.reset(new std::atomic<int>[mySteps.size()]);
+}
+
+void CompiledGraph::createRecords(std::vector<ValueColumnPtr>& columns, std::vector<ValueColumnPtr>& input_columns, std::vector<SampleRecord>& records, size_t capacity, bool shared_views)
+{
+    columns.clear();
+    input_columns.clear();
+    records.resize(capacity);
+
+    for(size_t j=0; j<myValueFactories.size(); j++)
+    {
+        if(shared_views && mySharedValues[j] && myCopiedValues[j] == false)
+        {
+            std::vector<ValuePtr> values(capacity);
+
+            for(ValuePtr& v : values)
+            {
+                v = myValueFactories[j]->createValue();
+            }
+
+            columns.push_back(std::make_shared<SharedColumn>(std::move(values)));
+        }
+        else
+        {
+            columns.push_back(myValueFactories[j]->createColumn(capacity));
+        }
+    }
+
+    for(size_t index : myInputIndices)
+    {
+        input_columns.push_back(columns[index]);
+    }
+
+    for(size_t i=0; i<capacity; i++)
+    {
+        SampleRecord& record = records[i];
+
+        record.values.clear();
+        record.inputs.clear();
+        record.design.assign(myDesignDimensions, 0.0);
+        record.sample = 0;
+
+        for(const ValueColumnPtr& column : columns)
+        {
+            record.values.push_back(column->refValue(i));
+        }
+
+        for(size_t index : myInputIndices)
+        {
+            record.inputs.push_back(record.values[index]);
+        }
+    }
+}
+
+size_t CompiledGraph::getMemorySize(const SampleBatch& batch)
+{
+    size_t ret = 0;
+
+    // values are counted once per column, as shared values are referenced by several records. Views on the upstream values are skipped.
+
+    for(const std::vector<ValueColumnPtr>* columns : { &batch.columns, &batch.upstream_columns })
+    {
+        for(const ValueColumnPtr& column : *columns)
+        {
+            const bool view = (dynamic_cast<const SharedColumn*>(column.get()) != nullptr);
+
+            for(size_t i=0; view == false && i<column->size(); i++)
+            {
+                ret += column->refValue(i)->getMemorySize();
+            }
+        }
+    }
+
+    return ret;
+}
+
+void CompiledGraph::execute(uint64_t seed, SampleBatch& batch)
+{
+    if(myMultiplicity > 1)
+    {
+        groupSamples(batch);
+    }
+
+    if(myDesign)
+    {
+        generateDesign(batch);
+    }
+
+    if(mySource != nullptr)
+    {
+        loadValues(batch);
+    }
+
+    for(const Step& step : mySteps)
+    {
+        runStep(step, seed, batch);
+    }
+}
+
+void CompiledGraph::executeParallel(uint64_t seed, SampleBatch& batch)
+{
+    if(myMultiplicity > 1)
+    {
+        groupSamples(batch);
+    }
+
+    if(myDesign)
+    {
+        generateDesign(batch);
+    }
+
+    if(mySource != nullptr)
+    {
+        loadValues(batch);
+    }
+
+    ParallelExecution execution(this, seed, &batch);
+    execution.run();
+}
+
+void CompiledGraph::runStep(const Step& step, uint64_t seed, SampleBatch& batch)
+{
+    // values read from the source are already in the records.
+
+    if(step.loaded || step.skipped)
+    {
+        return;
+    }
+
+    SampleRecord* records = batch.records.data();
+    size_t size = batch.size;
+    ValueColumnPtr* input_columns = batch.input_columns.data();
+    ValueColumnPtr* columns = batch.columns.data();
+
+    // shared steps are computed once per upstream sample.
+
+    if(step.shared)
+    {
+        records = batch.upstream_records.data();
+        size = batch.upstream_size;
+        input_columns = batch.upstream_input_columns.data();
+        columns = batch.upstream_columns.data();
+    }
+
+    BatchContext context(seed, step.id, records, size, step.input_begin, step.input_end, step.output_begin, step.output_end, step.design_begin, step.design_end);
+
+    const ColumnSpan input(input_columns + step.input_begin, step.input_end - step.input_begin);
+    const ColumnSpan output(columns + step.output_begin, step.output_end - step.output_begin);
+
+    const uint64_t start = (myRunStats != nullptr) ? RunStats::getTime() : 0;
+
+    if(step.memoized && myMemoCache)
+    {
+        runMemoizedStep(step, context, input, output, batch);
+    }
+    else
+    {
+        step.node->getSampleBatch(context, input, output);
+    }
+
+    if(myRunStats != nullptr)
+    {
+        myRunStats->addNodeCall(&step - mySteps.data(), size, RunStats::getTime() - start);
+    }
+
+    if(step.shared)
+    {
+        shareOutputs(step, batch);
+    }
+}
+
+void CompiledGraph::runMemoizedStep(const Step& step, BatchContext& context, const ColumnSpan& input, const ColumnSpan& output, SampleBatch& batch)
+{
+    // each memoized step has its own slice of the scratch buffers, as the steps of a batch may run concurrently.
+
+    uint64_t* keys = batch.memo_keys.data() + step.memo_slot * batch.records.size();
+    char* missed = batch.memo_missed.data() + step.memo_slot * batch.records.size();
+    size_t num_missed = 0;
+
+    for(size_t i=0; i<context.getSize(); i++)
+    {
+        keys[i] = MemoCache::getKey(step.id, context.getInput(i));
+        missed[i] = (myMemoCache->load(keys[i], step.id, context.getInput(i), context.getOutput(i)) == false);
+
+        if(missed[i])
+        {
+            num_missed++;
+        }
+    }
+
+    // the whole batch is computed at once if nothing was found, otherwise the missing samples are computed one by one.
+
+    if(num_missed == context.getSize())
+    {
+        step.node->getSampleBatch(context, input, output);
+    }
+    else
+    {
+        for(size_t i=0; i<context.getSize(); i++)
+        {
+            if(missed[i])
+            {
+                SampleContext sample_context = context.getSampleContext(i);
+                step.node->getSample(sample_context, context.getInput(i), context.getOutput(i));
+            }
+        }
+    }
+
+    for(size_t i=0; i<context.getSize(); i++)
+    {
+        if(missed[i])
+        {
+            myMemoCache->store(keys[i], step.id, context.getInput(i), context.getOutput(i));
+        }
+    }
+}
+
+void CompiledGraph::groupSamples(SampleBatch& batch)
+{
+    int* upstream_ids = static_cast<IntegerColumn&>(*batch.columns[myUpstreamIdIndex]).data();
+
+    batch.upstream_size = 0;
+
+    for(size_t i=0; i<batch.size; i++)
+    {
+        const int upstream = batch.records[i].sample / myMultiplicity;
+
+        if(batch.upstream_size == 0 || batch.upstream_records[batch.upstream_size-1].sample != upstream)
+        {
+            batch.upstream_records[batch.upstream_size].sample = upstream;
+            batch.upstream_size++;
+        }
+
+        batch.groups[i] = batch.upstream_size-1;
+        upstream_ids[i] = upstream;
+    }
+}
+
+void CompiledGraph::generateDesign(SampleBatch& batch)
+{
+    for(size_t i=0; i<batch.size; i++)
+    {
+        myDesign->getPoint(batch.records[i].sample, batch.records[i].design.data());
+    }
+
+    if(myUpstreamDesign)
+    {
+        for(size_t i=0; i<batch.upstream_size; i++)
+        {
+            myUpstreamDesign->getPoint(batch.upstream_records[i].sample, batch.upstream_records[i].design.data());
+        }
+    }
+}
+
+void CompiledGraph::shareOutputs(const Step& step, SampleBatch& batch)
+{
+    for(size_t j=step.output_begin; j<step.output_end; j++)
+    {
+        if(myCopiedValues[j])
+        {
+            const ValueColumnPtr& column = batch.columns[j];
+
+            for(size_t i=0; i<batch.size; i++)
+            {
+                column->refValue(i)->assign(*batch.upstream_records[batch.groups[i]].values[j]);
+            }
+        }
+        else
+        {
+            SharedColumn& column = static_cast<SharedColumn&>(*batch.columns[j]);
+
+            for(size_t i=0; i<batch.size; i++)
+            {
+                SampleRecord& record = batch.records[i];
+                const ValuePtr& value = batch.upstream_records[batch.groups[i]].values[j];
+
+                column.setValue(i, value);
+                record.values[j] = value;
+
+                for(size_t k : myInputSlots[j])
+                {
+                    record.inputs[k] = value;
+                }
+            }
+        }
+    }
+}
+
+void CompiledGraph::loadValues(SampleBatch& batch)
+{
+    bool ok = true;
+    bool has_shared = false;
+
+    // values of shared steps are read into the upstream records, from the first row of their group, then shared as if computed.
+
+    auto read_values = [this] (int sample, SampleRecord& record, bool shared)
+    {
+        return mySource->read(sample, [this,&record,shared] (FieldReader& reader)
+        {
+            bool ret = true;
+
+            for(const Step& step : mySteps)
+            {
+                for(size_t j=step.output_begin; ret && step.loaded && step.shared == shared && j<step.output_end; j++)
+                {
+                    int offset = int(myFieldOffsets[j]);
+                    ret = record.values[j]->read(reader, offset);
+                }
+            }
+
+            return ret;
+        });
+    };
+
+    for(const Step& step : mySteps)
+    {
+        has_shared = has_shared || (step.loaded && step.shared);
+    }
+
+    for(size_t i=0; ok && i<batch.size; i++)
+    {
+        ok = read_values(batch.records[i].sample, batch.records[i], false);
+    }
+
+    for(size_t i=0; ok && has_shared && i<batch.size; i++)
+    {
+        if(i == 0 || batch.groups[i] != batch.groups[i-1])
+        {
+            ok = read_values(batch.records[i].sample, batch.upstream_records[batch.groups[i]], true);
+        }
+    }
+
+    for(size_t i=0; ok && has_shared && i<mySteps.size(); i++)
+    {
+        if(mySteps[i].loaded && mySteps[i].shared)
+        {
+            shareOutputs(mySteps[i], batch);
+        }
+    }
+
+    batch.failed = batch.failed || (ok == false);
+}
+
+bool CompiledGraph::reorderNodes(const std::vector<NodePtr>& graph, std::vector<NodePtr>& ordered_nodes)
+{
+    std::map< std::string, std::vector<size_t> > children;
+    std::vector<size_t> pending_dependencies(graph.size());
+    std::stack<size_t> stack;
+
+    // a node is ready once all its dependencies are processed, hence its number of pending dependencies
+    // reaches zero. This takes linear time, even for nodes with many dependencies.
+
+    for(size_t i=0; i<graph.size(); i++)
+    {
+        pending_dependencies[i] = graph[i]->refDependencies().size();
+
+        for(const std::string& parent : graph[i]->refDependencies())
+        {
+            children[parent].push_back(i);
+        }
+    }
+
+    ordered_nodes.clear();
+
+    for(size_t root=0; root<graph.size(); root++)
+    {
+        if( graph[root]->refDependencies().empty() )
+        {
+            stack.push(root);
+            ordered_nodes.push_back(graph[root]);
+
+            while(stack.empty() == false)
+            {
+                const size_t node = stack.top();
+                stack.pop();
+
+                for(size_t child : children[graph[node]->getName()])
+                {
+                    if(--pending_dependencies[child] == 0)
+                    {
+                        stack.push(child);
+                        ordered_nodes.push_back(graph[child]);
+                    }
+                }
+            }
+        }
+    }
+
+    // nodes with missing dependencies or in a cycle are never reached.
+
+    return (ordered_nodes.size() == graph.size());
+}
+
@@ -0,0 +1,190 @@
+
+#pragma once
+
+#include <atomic>
+#include "banesa_core.h"
+#include "banesa_memo_cache.h"
+#include "banesa_design.h"
+#include "banesa_run_stats.h"
+#include "banesa_sink.h"
+
+// Values of a batch of samples, stored as one column per value. The records are views on the columns,
+// hence the columns must outlive them. Only the first size records belong to the current batch.
+// With fan-out, the shared values are computed in the upstream records, one per group of consecutive records with the same upstream sample.
+// The memo buffers are scratch space of the memoized steps, capacity entries per step.
+
+struct SampleBatch
+{
+    std::vector<ValueColumnPtr> columns;
+    std::vector<ValueColumnPtr> input_columns;
+    std::vector<SampleRecord> records;
+    std::vector<ValueColumnPtr> upstream_columns;
+    std::vector<ValueColumnPtr> upstream_input_columns;
+    std::vector<SampleRecord> upstream_records;
+    std::vector<size_t> groups;
+    std::vector<uint64_t> memo_keys;
+    std::vector<char> memo_missed;
+    size_t upstream_size;
+    std::unique_ptr< std::atomic<int>[] > pending_parents;
+    size_t size;
+    size_t sequence;
+    bool failed;
+    size_t memory_size;
+};
+
+// Execution plan of a graph. Nodes are sorted in topological order and their
+// inputs and outputs are described by flat arrays of indices into the sample record.
+// Dead nodes, whose outputs are neither exported nor consumed by a live node, are never computed.
+// Nodes with side effects (see Node::setSideEffects()) and nodes without outputs are kept.
+
+class CompiledGraph
+{
+public:
+
+    CompiledGraph();
+
+    bool build(const std::vector<NodePtr>& graph);
+
+    // Cache used to reuse the outputs of pure nodes. If null, all the nodes are computed.
+    void setMemoCache(MemoCachePtr cache)
+    {
+        myMemoCache = std::move(cache);
+    }
+
+    // Design of the points given to the nodes with design dimensions, over num_samples samples.
+    // With fan-out, the upstream samples get their own design over num_samples / multiplicity points.
+    // Returns false if the design does not support the number of dimensions of the graph.
+    bool setDesign(DesignType type, int num_samples, uint64_t seed);
+
+    // total number of design dimensions of the live nodes. Dead nodes get none.
+    int getDesignDimensions()
+    {
+        return myDesignDimensions;
+    }
+
+    // Incremental re-evaluation. The changed nodes and their descendants are computed, as well as the nodes whose values
+    // cannot be read back from the source (see Value::read()), which is checked on the probe sample. The other nodes
+    // are read from the source, or skipped if they have no field and no computed child. Null by default, meaning that all the nodes are computed.
+    // Returns false if a changed node is missing or if the probe sample cannot be read.
+    bool setSource(SampleSource* source, const std::vector<std::string>& changed_nodes, int probe_sample);
+
+    // Statistics receiving the duration of each node call, in the order of refOrderedNodes(). Null by default.
+    void setRunStats(RunStats* stats)
+    {
+        myRunStats = stats;
+    }
+
+    const std::vector<NodePtr>& refOrderedNodes()
+    {
+        return myOrderedNodes;
+    }
+
+    const std::vector<ValueFactoryPtr>& refValueFactories()
+    {
+        return myValueFactories;
+    }
+
+    const std::vector<Field>& refFields()
+    {
+        return myFields;
+    }
+
+    // number of nodes which are never computed because their outputs are not used.
+    int getNumDeadNodes()
+    {
+        return myNumDeadNodes;
+    }
+
+    // number of downstream samples per upstream sample (see Node::setMultiplicity()).
+    int getMultiplicity()
+    {
+        return myMultiplicity;
+    }
+
+    // indices of the values which may have a payload to save.
+    const std::vector<size_t>& refPayloadValues()
+    {
+        return myPayloadValues;
+    }
+
+    void createBatch(SampleBatch& batch, size_t capacity);
+
+    // memory held by the values of all the records of the batch (see Value::getMemorySize()).
+    static size_t getMemorySize(const SampleBatch& batch);
+
+    void execute(uint64_t seed, SampleBatch& batch);
+
+    // Same as execute() but independent nodes are run concurrently.
+    void executeParallel(uint64_t seed, SampleBatch& batch);
+
+private:
+
+    struct Step
+    {
+        Node* node;
+        uint32_t id;
+        size_t input_begin;
+        size_t input_end;
+        size_t output_begin;
+        size_t output_end;
+        size_t design_begin;
+        size_t design_end;
+        size_t children_begin;
+        size_t children_end;
+        int num_parents;
+        bool memoized;
+        size_t memo_slot;
+        bool shared;
+        bool live;
+        bool loaded;
+        bool skipped;
+    };
+
+    class ParallelExecution;
+    class SharedColumn;
+
+private:
+
+    void runStep(const Step& step, uint64_t seed, SampleBatch& batch);
+
+    void runMemoizedStep(const Step& step, BatchContext& context, const ColumnSpan& input, const ColumnSpan& output, SampleBatch& batch);
+
+    // if shared_views is true, the columns of the shared values which are not copied are views on the upstream values.
+    void createRecords(std::vector<ValueColumnPtr>& columns, std::vector<ValueColumnPtr>& input_columns, std::vector<SampleRecord>& records, size_t capacity, bool shared_views);
+
+    void groupSamples(SampleBatch& batch);
+
+    void generateDesign(SampleBatch& batch);
+
+    void shareOutputs(const Step& step, SampleBatch& batch);
+
+    void loadValues(SampleBatch& batch);
+
+    static bool reorderNodes(const std::vector<NodePtr>& graph, std::vector<NodePtr>& ordered_nodes);
+
+private:
+
+    std::vector<NodePtr> myOrderedNodes;
+    std::vector<ValueFactoryPtr> myValueFactories;
+    std::vector<Field> myFields;
+    std::vector<size_t> myFieldOffsets;
+    std::vector<size_t> myPayloadValues;
+    std::vector<Step> mySteps;
+    std::vector<size_t> myInputIndices;
+    std::vector<size_t> myChildren;
+    std::vector<size_t> myRootSteps;
+    MemoCachePtr myMemoCache;
+    RunStats* myRunStats;
+    int myMultiplicity;
+    int myNumDeadNodes;
+    size_t myNumMemoizedSteps;
+    size_t myUpstreamIdIndex;
+    std::vector< std::vector<size_t> > myInputSlots;
+    std::vector<bool> mySharedValues;
+    std::vector<bool> myCopiedValues;
+    int myDesignDimensions;
+    DesignPtr myDesign;
+    DesignPtr myUpstreamDesign;
+    SampleSource* mySource;
+};
+
@@ -0,0 +1,358 @@
+#include <cmath>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <algorithm>
+#include "banesa_convergence_monitor.h"
+
+// Retrieves the numeric fields of a sample.
+
+class ConvergenceMonitor::Reader : public FieldWriter
+{
+public:
+
+    Reader(std::vector<double>& row) : myRow(row)
+    {
+    }
+
+    void writeInteger(int column, int64_t value) override
+    {
+        myRow[column] = double(value);
+    }
+
+    void writeReal(int column, double value) override
+    {
+        myRow[column] = value;
+    }
+
+    void writeText(int column, const std::string& value) override
+    {
+    }
+
+    void writeBlob(int column, const void* data, size_t size) override
+    {
+    }
+
+protected:
+
+    std::vector<double>& myRow;
+};
+
+ConvergenceMonitor::ConvergenceMonitor()
+{
+    myStratumColumn = -1;
+    myConfidence = 0.95;
+    myZ = getNormalQuantile(0.975);
+    myMinimumSamples = 100;
+    myMaximumValues = 100000;
+    myNumColumns = 0;
+    myNumSamples = 0;
+    mySamplesSinceNewStratum = 0;
+    myConverged = false;
+}
+
+void ConvergenceMonitor::addMean(const std::string& field, double tolerance)
+{
+    myTargets.push_back(Target{field, Statistic::Mean, 0.0, tolerance, -1});
+}
+
+void ConvergenceMonitor::addQuantile(const std::string& field, double quantile, double tolerance)
+{
+    myTargets.push_back(Target{field, Statistic::Quantile, quantile, tolerance, -1});
+}
+
+void ConvergenceMonitor::setStratum(const std::string& field)
+{
+    myStratumField = field;
+}
+
+void ConvergenceMonitor::setExpectedStrata(const std::vector<double>& strata)
+{
+    myExpectedStrata = strata;
+}
+
+void ConvergenceMonitor::setConfidence(double confidence)
+{
+    myConfidence = confidence;
+    myZ = getNormalQuantile(0.5 + 0.5*confidence);
+}
+
+void ConvergenceMonitor::setMinimumSamples(int num_samples)
+{
+    myMinimumSamples = num_samples;
+}
+
+void ConvergenceMonitor::setMaximumValues(int num_values)
+{
+    myMaximumValues = size_t(std::max(1, num_values));
+}
+
+bool ConvergenceMonitor::open(const std::vector<Field>& fields)
+{
+    bool ok = true;
+
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    auto find_column = [&fields] (const std::string& name)
+    {
+        int ret = -1;
+
+        for(size_t i=0; ret < 0 && i<fields.size(); i++)
+        {
+            if(fields[i].name == name && (fields[i].type == FieldType::Integer || fields[i].type == FieldType::Real))
+            {
+                ret = int(i);
+            }
+        }
+
+        return ret;
+    };
+
+    for(Target& target : myTargets)
+    {
+        target.column = find_column(target.field);
+        ok = ok && (target.column >= 0);
+        ok = ok && (target.statistic == Statistic::Mean || (target.quantile >= 0.0 && target.quantile <= 1.0));
+    }
+
+    if(ok)
+    {
+        myStratumColumn = (myStratumField.empty()) ? -1 : find_column(myStratumField);
+        ok = (myStratumField.empty() || myStratumColumn >= 0);
+    }
+
+    ok = ok && (myTargets.empty() == false) && (myConfidence > 0.0 && myConfidence < 1.0);
+
+    myNumColumns = fields.size();
+    myStrata.clear();
+    myNumSamples = 0;
+    mySamplesSinceNewStratum = 0;
+    myConverged = false;
+
+    return ok;
+}
+
+void ConvergenceMonitor::add(const std::vector<ValuePtr>& values)
+{
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    Reader reader(myRow);
+    int offset = 0;
+
+    myRow.assign(myNumColumns, std::numeric_limits<double>::quiet_NaN());
+
+    for(const ValuePtr& value : values)
+    {
+        value->write(reader, offset);
+    }
+
+    const double key = (myStratumColumn >= 0) ? myRow[myStratumColumn] : 0.0;
+
+    // samples whose stratum is not a number cannot be ordered into a stratum, hence they are ignored.
+
+    if(std::isnan(key) == false)
+    {
+        Stratum& stratum = myStrata[key];
+
+        if(stratum.estimators.empty())
+        {
+            stratum.estimators.resize(myTargets.size(), Estimator{0, 0.0, 0.0, std::vector<double>(), 0, 0.0, 0.0, false});
+            stratum.count = 0;
+            stratum.converged = false;
+            mySamplesSinceNewStratum = 0;
+        }
+
+        stratum.count++;
+        stratum.converged = (stratum.count >= size_t(myMinimumSamples));
+
+        for(size_t i=0; i<myTargets.size(); i++)
+        {
+            update(myTargets[i], stratum.estimators[i], myRow[myTargets[i].column]);
+            stratum.converged = stratum.converged && stratum.estimators[i].converged;
+        }
+
+        myNumSamples++;
+        mySamplesSinceNewStratum++;
+
+        // once converged, the source stops and the samples in flight do not matter anymore.
+        // Without expected strata, a stratum which did not appear yet may still be rare, hence the delay after the last new one.
+
+        if(myConverged == false)
+        {
+            bool converged = true;
+
+            for(const auto& item : myStrata)
+            {
+                converged = converged && item.second.converged;
+            }
+
+            for(size_t i=0; converged && i<myExpectedStrata.size(); i++)
+            {
+                converged = (myStrata.count(myExpectedStrata[i]) > 0);
+            }
+
+            converged = converged && (myExpectedStrata.empty() == false || mySamplesSinceNewStratum >= size_t(myMinimumSamples));
+
+            myConverged = converged;
+        }
+    }
+}
+
+bool ConvergenceMonitor::isConverged()
+{
+    return myConverged;
+}
+
+size_t ConvergenceMonitor::getNumSamples()
+{
+    std::lock_guard<std::mutex> lock(myMutex);
+    return myNumSamples;
+}
+
+void ConvergenceMonitor::getRecords(std::vector<StatRecord>& records)
+{
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    records.clear();
+
+    for(auto& item : myStrata)
+    {
+        for(size_t i=0; i<myTargets.size(); i++)
+        {
+            const Target& target = myTargets[i];
+            Estimator& estimator = item.second.estimators[i];
+            std::stringstream name;
+
+            name << target.field;
+
+            if(target.statistic == Statistic::Quantile)
+            {
+                updateQuantile(target, estimator);
+                name << "_q" << target.quantile;
+            }
+            else
+            {
+                name << "_mean";
+            }
+
+            if(myStratumColumn >= 0)
+            {
+                name << "_" << myStratumField << "=" << item.first;
+            }
+
+            records.push_back(StatRecord{"convergence", name.str(), "estimate", -1, estimator.estimate});
+            records.push_back(StatRecord{"convergence", name.str(), "half_width", -1, estimator.half_width});
+            records.push_back(StatRecord{"convergence", name.str(), "samples", -1, double(estimator.count)});
+            records.push_back(StatRecord{"convergence", name.str(), "converged", -1, (estimator.converged) ? 1.0 : 0.0});
+        }
+    }
+}
+
+void ConvergenceMonitor::update(const Target& target, Estimator& estimator, double value)
+{
+    // missing values are ignored.
+
+    if(std::isnan(value) == false)
+    {
+        estimator.count++;
+
+        if(target.statistic == Statistic::Mean)
+        {
+            const double delta = value - estimator.mean;
+
+            estimator.mean += delta / estimator.count;
+            estimator.m2 += delta * (value - estimator.mean);
+            estimator.estimate = estimator.mean;
+            estimator.half_width = (estimator.count > 1) ? myZ * std::sqrt(estimator.m2 / (estimator.count - 1) / estimator.count) : std::numeric_limits<double>::infinity();
+        }
+        else
+        {
+            // once full, the reservoir keeps each of the values seen so far with the same probability.
+
+            if(estimator.values.size() < myMaximumValues)
+            {
+                estimator.values.push_back(value);
+            }
+            else
+            {
+                RandomStream random(0, estimator.count, 0);
+                const size_t index = std::uniform_int_distribution<size_t>(0, estimator.count-1)(random);
+
+                if(index < estimator.values.size())
+                {
+                    estimator.values[index] = value;
+                }
+            }
+
+            // the interval takes linear time, hence it is updated each time the number of values grows by some fraction.
+
+            if(estimator.count >= estimator.next_update)
+            {
+                updateQuantile(target, estimator);
+                estimator.next_update = estimator.count + std::max<size_t>(1, estimator.count/32);
+            }
+        }
+
+        estimator.converged = (estimator.count >= size_t(myMinimumSamples) && estimator.half_width <= target.tolerance);
+    }
+}
+
+void ConvergenceMonitor::updateQuantile(const Target& target, Estimator& estimator)
+{
+    std::vector<double>& values = estimator.values;
+    const double n = double(values.size());
+    const double p = target.quantile;
+
+    if(values.empty() == false)
+    {
+        // the ranks of the bounds are given by the normal approximation of the binomial distribution.
+
+        const double spread = myZ * std::sqrt(n * p * (1.0 - p));
+        const size_t last = values.size() - 1;
+        const size_t rank = std::min(last, size_t(p * last));
+        const double lower_rank = std::floor(n*p - spread);
+        const double upper_rank = std::ceil(n*p + spread);
+
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        estimator.estimate = values[rank];
+
+        if(lower_rank < 0.0 || upper_rank > double(last))
+        {
+            estimator.half_width = std::numeric_limits<double>::infinity();
+        }
+        else
+        {
+            std::nth_element(values.begin(), values.begin() + size_t(lower_rank), values.end());
+            const double lower = values[size_t(lower_rank)];
+
+            std::nth_element(values.begin(), values.begin() + size_t(upper_rank), values.end());
+            const double upper = values[size_t(upper_rank)];
+
+            estimator.half_width = 0.5 * (upper - lower);
+        }
+    }
+}
+
+double ConvergenceMonitor::getNormalQuantile(double p)
+{
+    // bisection on the cumulative distribution function.
+
+    double a = -40.0;
+    double b = 40.0;
+
+    for(int i=0; i<200; i++)
+    {
+        const double x = 0.5*(a+b);
+
+        if(0.5 * std::erfc(-x / std::sqrt(2.0)) < p)
+        {
+            a = x;
+        }
+        else
+        {
+            b = x;
+        }
+    }
+
+    return 0.5*(a+b);
+}
@@ -0,0 +1,128 @@
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include "banesa_core.h"
+#include "banesa_sink.h"
+
+// Stopping rule of a sampling campaign. Estimators of the mean or of quantiles of some output fields are updated
+// as samples are exported, and the sampler stops issuing new samples once the half-width of the confidence interval
+// of every estimator is below its tolerance. The number of samples given to Sampler::run() is then an upper bound.
+// Means use Welford's algorithm and a normal approximation. Quantiles keep a uniform random subset of bounded size of the values
+// of their field (reservoir sampling) and use the confidence interval given by the order statistics of this subset, which does
+// not depend on the distribution.
+// With a stratum field, the estimators are computed for each value of this field and all the strata must converge: either the
+// expected strata, if given, or all the strata seen, the last of which must have appeared at least the minimum number of samples before.
+// Samples whose stratum field is missing or not a number are ignored.
+// Only the samples computed by the run are taken into account, not those already stored in append mode.
+// The methods may be called concurrently.
+
+class ConvergenceMonitor
+{
+public:
+
+    ConvergenceMonitor();
+
+    // The field must be numeric. The tolerance is on the half-width of the confidence interval of the mean.
+    void addMean(const std::string& field, double tolerance);
+
+    // quantile is in [0,1]. The tolerance is on the half-width of the confidence interval of the quantile.
+    void addQuantile(const std::string& field, double quantile, double tolerance);
+
+    // Numeric field whose values define the strata. None by default.
+    void setStratum(const std::string& field);
+
+    // Values of the stratum field which must all be seen, and converge, before the campaign stops. None by default.
+    void setExpectedStrata(const std::vector<double>& strata);
+
+    // Confidence level of the intervals, 0.95 by default.
+    void setConfidence(double confidence);
+
+    // Number of samples below which an estimator, or a stratum, is never considered converged. 100 by default.
+    void setMinimumSamples(int num_samples);
+
+    // Maximum number of values kept by each quantile estimator, 100000 by default. Beyond it, the interval is that of the
+    // subset kept, hence a tolerance smaller than the half-width reachable with this number of values is never met.
+    void setMaximumValues(int num_values);
+
+    // Called by the sampler at the beginning of a run, which resets the estimators. Returns false if a field is missing.
+    bool open(const std::vector<Field>& fields);
+
+    void add(const std::vector<ValuePtr>& values);
+
+    bool isConverged();
+
+    size_t getNumSamples();
+
+    // Estimate, half-width, number of samples and convergence of each estimator, in category "convergence".
+    void getRecords(std::vector<StatRecord>& records);
+
+private:
+
+    enum class Statistic
+    {
+        Mean,
+        Quantile
+    };
+
+    struct Target
+    {
+        std::string field;
+        Statistic statistic;
+        double quantile;
+        double tolerance;
+        int column;
+    };
+
+    struct Estimator
+    {
+        size_t count;
+        double mean;
+        double m2;
+        std::vector<double> values;
+        size_t next_update;
+        double estimate;
+        double half_width;
+        bool converged;
+    };
+
+    struct Stratum
+    {
+        std::vector<Estimator> estimators;
+        size_t count;
+        bool converged;
+    };
+
+    class Reader;
+
+private:
+
+    void update(const Target& target, Estimator& estimator, double value);
+
+    void updateQuantile(const Target& target, Estimator& estimator);
+
+    static double getNormalQuantile(double p);
+
+private:
+
+    std::vector<Target> myTargets;
+    std::string myStratumField;
+    std::vector<double> myExpectedStrata;
+    int myStratumColumn;
+    double myConfidence;
+    double myZ;
+    int myMinimumSamples;
+    size_t myMaximumValues;
+    size_t myNumColumns;
+
+    std::mutex myMutex;
+    std::map<double, Stratum> myStrata;
+    std::vector<double> myRow;
+    size_t myNumSamples;
+    size_t mySamplesSinceNewStratum;
+    std::atomic<bool> myConverged;
+};
+
+using ConvergenceMonitorPtr = std::shared_ptr<ConvergenceMonitor>;
@@ -3,11 +3,213 @@
 
 #include <vector>
 #include <memory>
-#include <sqlite3.h>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include "banesa_random.h"
+
+enum class FieldType
+{
+    Integer,
+    Real,
+    Text,
+    Blob
+};
+
+struct Field
+{
+    std::string name;
+    FieldType type;
+};
+
+class FieldWriter
+{
+public:
+
+    virtual void writeInteger(int column, int64_t value) = 0;
+    virtual void writeReal(int column, double value) = 0;
+    virtual void writeText(int column, const std::string& value) = 0;
+
+    // The data remains valid until the sink returns from Sink::write(), hence writers which keep it longer must copy it.
+    virtual void writeBlob(int column, const void* data, size_t size) = 0;
+};
+
+// Fields of a sample stored by a previous run. The methods return false if the field is missing or null.
+
+class FieldReader
+{
+public:
+
+    virtual bool readInteger(int column, int64_t& value) = 0;
+    virtual bool readReal(int column, double& value) = 0;
+    virtual bool readText(int column, std::string& value) = 0;
+
+    // The data is not copied and remains valid until the reader is released.
+    virtual bool readBlob(int column, const void*& data, size_t& size) = 0;
+};
 
 class ValueFactory;
+class ValueColumn;
+class PayloadContext;
+
+inline uint64_t combineHash(uint64_t seed, uint64_t hash)
+{
+    // splitmix64 finalizer.
+
+    uint64_t x = seed ^ (hash + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Hash, equality and deep copy of objects of type T, used to memoize pure nodes (see Node::setPure()).
+// Specialize it for other types, for example images, copy() being a deep copy.
+
+template<typename T, typename Enable=void>
+struct ValueContent
+{
+    static const bool supported = false;
+
+    static uint64_t hash(const T& value)
+    {
+        return 0;
+    }
+
+    static bool equal(const T& a, const T& b)
+    {
+        return false;
+    }
+
+    static void copy(const T& from, T& to)
+    {
+    }
+};
+
+template<typename T>
+struct ValueContent<T, typename std::enable_if< std::is_arithmetic<T>::value && sizeof(T) <= sizeof(uint64_t) >::type>
+{
+    static const bool supported = true;
+
+    static uint64_t hash(const T& value)
+    {
+        uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(T));
+        return combineHash(0, bits);
+    }
+
+    static bool equal(const T& a, const T& b)
+    {
+        return a == b;
+    }
+
+    static void copy(const T& from, T& to)
+    {
+        to = from;
+    }
+};
+
+template<>
+struct ValueContent<std::string>
+{
+    static const bool supported = true;
+
+    static uint64_t hash(const std::string& value)
+    {
+        return combineHash(0, std::hash<std::string>()(value));
+    }
+
+    static bool equal(const std::string& a, const std::string& b)
+    {
+        return a == b;
+    }
+
+    static void copy(const std::string& from, std::string& to)
+    {
+        to = from;
+    }
+};
+
+template<typename T>
+struct ValueContent< std::vector<T>, typename std::enable_if< ValueContent<T>::supported >::type >
+{
+    static const bool supported = true;
+
+    static uint64_t hash(const std::vector<T>& value)
+    {
+        uint64_t ret = combineHash(0, value.size());
+
+        for(const T& item : value)
+        {
+            ret = combineHash(ret, ValueContent<T>::hash(item));
+        }
+
+        return ret;
+    }
+
+    static bool equal(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        bool ret = (a.size() == b.size());
+
+        for(size_t i=0; ret && i<a.size(); i++)
+        {
+            ret = ValueContent<T>::equal(a[i], b[i]);
+        }
+
+        return ret;
+    }
+
+    static void copy(const std::vector<T>& from, std::vector<T>& to)
+    {
+        to.resize(from.size());
+
+        for(size_t i=0; i<from.size(); i++)
+        {
+            ValueContent<T>::copy(from[i], to[i]);
+        }
+    }
+};
+
+// Number of bytes owned by an object of type T, including the memory it allocated.
+// Specialize it for types which allocate memory, for example images.
+
+template<typename T>
+struct MemorySize
+{
+    static size_t get(const T& value)
+    {
+        return sizeof(T);
+    }
+};
+
+template<>
+struct MemorySize<std::string>
+{
+    static size_t get(const std::string& value)
+    {
+        return sizeof(std::string) + value.capacity();
+    }
+};
+
+template<typename T>
+struct MemorySize< std::vector<T> >
+{
+    static size_t get(const std::vector<T>& value)
+    {
+        size_t ret = sizeof(std::vector<T>) + (value.capacity() - value.size()) * sizeof(T);
+
+        for(const T& item : value)
+        {
+            ret += MemorySize<T>::get(item);
+        }
+
+        return ret;
+    }
+};
 
 using ValueFactoryPtr = std::shared_ptr<ValueFactory>;
+using ValueColumnPtr = std::shared_ptr<ValueColumn>;
 
 class Value
 {
@@ -22,7 +224,48 @@ public:
         return myFactory;
     }
 
-    virtual void bind(sqlite3_stmt* stmt, int& offset) = 0;
+    virtual void write(FieldWriter& writer, int& offset) = 0;
+
+    // Restores the value from the fields saved by write(), for incremental re-evaluation (see Sampler::runIncremental()).
+    // Returns false if the value cannot be restored, in which case its node is computed again.
+    virtual bool read(FieldReader& reader, int& offset)
+    {
+        return false;
+    }
+
+    // Saves the content of the value which is not stored in the database. Returns false on error.
+    virtual bool savePayload(PayloadContext& context)
+    {
+        return true;
+    }
+
+    // Approximate number of bytes held by the value, used to bound the memory of the samples in flight.
+    virtual size_t getMemorySize() const
+    {
+        return 0;
+    }
+
+    // Whether the value supports getHash(), isEqual() and assign(), which are used to memoize pure nodes.
+    virtual bool isComparable() const
+    {
+        return false;
+    }
+
+    virtual uint64_t getHash() const
+    {
+        return 0;
+    }
+
+    // other is a value of the same type.
+    virtual bool isEqual(const Value& other) const
+    {
+        return false;
+    }
+
+    // Deep copy of the content of other, which is a value of the same type.
+    virtual void assign(const Value& other)
+    {
+    }
 
 private:
 
@@ -31,6 +274,42 @@ private:
 
 using ValuePtr = std::shared_ptr<Value>;
 
+// Values of a batch of samples. Each value of the column is a view on the sample at the same index.
+// Derived columns may store the data of the values contiguously (structure of arrays).
+
+class ValueColumn
+{
+public:
+
+    ValueColumn(std::vector<ValuePtr> values) : myValues(std::move(values))
+    {
+    }
+
+    virtual ~ValueColumn()
+    {
+    }
+
+    size_t size()
+    {
+        return myValues.size();
+    }
+
+    const ValuePtr& refValue(size_t index)
+    {
+        return myValues[index];
+    }
+
+protected:
+
+    ValueColumn()
+    {
+    }
+
+protected:
+
+    std::vector<ValuePtr> myValues;
+};
+
 class ValueFactory : public std::enable_shared_from_this<ValueFactory>
 {
 public:
@@ -44,22 +323,233 @@ public:
         return myName;
     }
 
-    virtual void getSqlFieldNames(std::vector<std::string>& names) = 0;
-    virtual void getSqlFieldTypes(std::vector<std::string>& sqltypes) = 0;
+    virtual void getFields(std::vector<Field>& fields) = 0;
 
     virtual ValuePtr createValue() = 0;
 
+    // Whether the values may have a payload to be saved to a file.
+    virtual bool hasPayload()
+    {
+        return false;
+    }
+
+    // The default column holds independently allocated values.
+    virtual ValueColumnPtr createColumn(size_t size)
+    {
+        std::vector<ValuePtr> values(size);
+
+        for(ValuePtr& v : values)
+        {
+            v = createValue();
+        }
+
+        return std::make_shared<ValueColumn>(std::move(values));
+    }
+
 private:
 
     std::string myName;
 };
 
+// Lightweight view on a contiguous range of values or columns.
+
+template<typename T>
+class Span
+{
+public:
+
+    Span(const T* data, size_t size)
+    {
+        myData = data;
+        mySize = size;
+    }
+
+    const T& operator[](size_t i) const
+    {
+        return myData[i];
+    }
+
+    size_t size() const
+    {
+        return mySize;
+    }
+
+    bool empty() const
+    {
+        return (mySize == 0);
+    }
+
+    const T* begin() const
+    {
+        return myData;
+    }
+
+    const T* end() const
+    {
+        return myData + mySize;
+    }
+
+private:
+
+    const T* myData;
+    size_t mySize;
+};
+
+using ValueSpan = Span<ValuePtr>;
+using ColumnSpan = Span<ValueColumnPtr>;
+
+// Values of one sample. The inputs of all the nodes are gathered once when the record is allocated,
+// so that the values of a node are contiguous both in the inputs and in the values arrays.
+
+struct SampleRecord
+{
+    std::vector<ValuePtr> values;
+    std::vector<ValuePtr> inputs;
+    std::vector<double> design;
+    int sample;
+};
+
+// Information given to a node when it computes a sample.
+// The random stream only depends on the seed of the run, on the sample and on the node, hence
+// the result of a sample does not depend on the number of threads nor on the other samples.
+
+class SampleContext
+{
+public:
+
+    SampleContext(uint64_t seed, int sample, uint32_t node, const double* design=nullptr, int design_dimensions=0) : myRandom(seed, sample, node)
+    {
+        mySample = sample;
+        myDesign = design;
+        myDesignDimensions = design_dimensions;
+    }
+
+    int getSample()
+    {
+        return mySample;
+    }
+
+    RandomStream& refRandom()
+    {
+        return myRandom;
+    }
+
+    // coordinates in [0,1) of the design point of the sample (see Node::setDesignDimensions()).
+    const double* getDesignPoint()
+    {
+        return myDesign;
+    }
+
+    int getDesignDimensions()
+    {
+        return myDesignDimensions;
+    }
+
+private:
+
+    int mySample;
+    RandomStream myRandom;
+    const double* myDesign;
+    int myDesignDimensions;
+};
+
+// Information given to a node when it computes a batch of samples.
+
+class BatchContext
+{
+public:
+
+    BatchContext(
+        uint64_t seed,
+        uint32_t node,
+        SampleRecord* records,
+        size_t size,
+        size_t input_begin,
+        size_t input_end,
+        size_t output_begin,
+        size_t output_end,
+        size_t design_begin=0,
+        size_t design_end=0)
+    {
+        mySeed = seed;
+        myNode = node;
+        myRecords = records;
+        mySize = size;
+        myInputBegin = input_begin;
+        myInputEnd = input_end;
+        myOutputBegin = output_begin;
+        myOutputEnd = output_end;
+        myDesignBegin = design_begin;
+        myDesignEnd = design_end;
+    }
+
+    size_t getSize()
+    {
+        return mySize;
+    }
+
+    int getSample(size_t index)
+    {
+        return myRecords[index].sample;
+    }
+
+    SampleContext getSampleContext(size_t index)
+    {
+        return SampleContext(mySeed, getSample(index), myNode, getDesignPoint(index), getDesignDimensions());
+    }
+
+    RandomStream getRandomStream(size_t index)
+    {
+        return RandomStream(mySeed, getSample(index), myNode);
+    }
+
+    // views on the values of one sample of the batch.
+
+    ValueSpan getInput(size_t index)
+    {
+        return ValueSpan(myRecords[index].inputs.data() + myInputBegin, myInputEnd - myInputBegin);
+    }
+
+    ValueSpan getOutput(size_t index)
+    {
+        return ValueSpan(myRecords[index].values.data() + myOutputBegin, myOutputEnd - myOutputBegin);
+    }
+
+    const double* getDesignPoint(size_t index)
+    {
+        return (myDesignEnd > myDesignBegin) ? myRecords[index].design.data() + myDesignBegin : nullptr;
+    }
+
+    int getDesignDimensions()
+    {
+        return int(myDesignEnd - myDesignBegin);
+    }
+
+private:
+
+    uint64_t mySeed;
+    uint32_t myNode;
+    SampleRecord* myRecords;
+    size_t mySize;
+    size_t myInputBegin;
+    size_t myInputEnd;
+    size_t myOutputBegin;
+    size_t myOutputEnd;
+    size_t myDesignBegin;
+    size_t myDesignEnd;
+};
+
 class Node
 {
 public:
 
     Node()
     {
+        myId = 0;
+        myPure = false;
+        mySideEffects = false;
+        myMultiplicity = 1;
+        myDesignDimensions = 0;
     }
 
     std::string getName()
@@ -67,6 +557,12 @@ public:
         return myName;
     }
 
+    // identifier derived from the name, used to select the random stream of the node.
+    uint32_t getId()
+    {
+        return myId;
+    }
+
     const std::vector<std::string>& refDependencies()
     {
         return myDependencies;
@@ -77,13 +573,59 @@ public:
         return myValueFactories;
     }
 
-    virtual void getSample(const std::vector<ValuePtr>& input, std::vector<ValuePtr>& output) = 0;
+    bool isPure()
+    {
+        return myPure;
+    }
+
+    bool hasSideEffects()
+    {
+        return mySideEffects;
+    }
+
+    int getMultiplicity()
+    {
+        return myMultiplicity;
+    }
+
+    int getDesignDimensions()
+    {
+        return myDesignDimensions;
+    }
+
+    virtual void getSample(SampleContext& context, const ValueSpan& input, const ValueSpan& output) = 0;
+
+    // Computes all the samples of a batch at once, the values being given as columns.
+    // Only the first context.getSize() entries of the columns belong to the batch.
+    // The default implementation calls getSample() for each sample.
+    virtual void getSampleBatch(BatchContext& context, const ColumnSpan& input, const ColumnSpan& output)
+    {
+        for(size_t i=0; i<context.getSize(); i++)
+        {
+            SampleContext sample_context = context.getSampleContext(i);
+            getSample(sample_context, context.getInput(i), context.getOutput(i));
+        }
+    }
+
+    // Called once per run, before sampling, to check that the node is connected to values of the expected types.
+    virtual bool checkValues(const ValueSpan& input, const ValueSpan& output)
+    {
+        return true;
+    }
 
 protected:
 
     void setName(const std::string& name)
     {
         myName = name;
+
+        // FNV-1a hash.
+
+        myId = 2166136261u;
+        for(char c : name)
+        {
+            myId = (myId ^ uint8_t(c)) * 16777619u;
+        }
     }
 
     void registerDependency(const std::string& dependency)
@@ -96,9 +638,45 @@ protected:
         myValueFactories.push_back(std::move(factory));
     }
 
+    // A pure node computes its outputs from its inputs only, without random numbers nor side effects.
+    // Its outputs may then be reused for identical inputs (see MemoCache), provided that all its values are comparable.
+    void setPure(bool pure)
+    {
+        myPure = pure;
+    }
+
+    // A node with side effects, for example writing files itself, is always computed. Otherwise, a node whose outputs
+    // are neither exported nor consumed by a computed node is never computed (see CompiledGraph), unless it has no output at all.
+    void setSideEffects(bool side_effects)
+    {
+        mySideEffects = side_effects;
+    }
+
+    // Fan-out: the node and its descendants are computed multiplicity times per sample of the other nodes,
+    // which are computed once and shared read-only. Sample s is then the draw s % multiplicity of upstream sample s / multiplicity,
+    // and nodes which are not downstream of the fan-out see the upstream sample in their context.
+    // All the nodes of a graph with a multiplicity greater than one must have the same multiplicity.
+    void setMultiplicity(int multiplicity)
+    {
+        myMultiplicity = multiplicity;
+    }
+
+    // Number of coordinates of the design point received by the node for each sample (see SampleContext::getDesignPoint()),
+    // which the node maps through its distributions instead of drawing random numbers. The sampler chooses the design
+    // (see Sampler::setDesign()) and gives distinct coordinates to distinct nodes. Nodes with design dimensions are not memoized.
+    void setDesignDimensions(int dimensions)
+    {
+        myDesignDimensions = dimensions;
+    }
+
 private:
 
     std::string myName;
+    uint32_t myId;
+    bool myPure;
+    bool mySideEffects;
+    int myMultiplicity;
+    int myDesignDimensions;
     std::vector<ValueFactoryPtr> myValueFactories;
     std::vector<std::string> myDependencies;
 };
@@ -0,0 +1,306 @@
+#include <cmath>
+#include <algorithm>
+#include "banesa_design.h"
+
+// Sobol direction numbers (Joe and Kuo, new-joe-kuo-6.21201) for dimensions 2 to 21:
+// degree s of the primitive polynomial, its coefficients a and the initial numbers m.
+
+struct SobolPolynomial
+{
+    int s;
+    uint32_t a;
+    uint32_t m[7];
+};
+
+static const SobolPolynomial sobol_polynomials[] =
+{
+    {1, 0, {1}},
+    {2, 1, {1, 3}},
+    {3, 1, {1, 3, 1}},
+    {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}},
+    {4, 4, {1, 3, 5, 13}},
+    {5, 2, {1, 1, 5, 5, 17}},
+    {5, 4, {1, 1, 5, 5, 5}},
+    {5, 7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}},
+    {5, 14, {1, 3, 5, 5, 31}},
+    {6, 1, {1, 3, 3, 9, 7, 49}},
+    {6, 13, {1, 1, 1, 15, 21, 21}},
+    {6, 16, {1, 3, 1, 13, 27, 49}},
+    {6, 19, {1, 1, 1, 15, 7, 5}},
+    {6, 22, {1, 3, 1, 15, 13, 25}},
+    {6, 25, {1, 1, 5, 5, 19, 61}},
+    {7, 1, {1, 3, 7, 11, 23, 15, 103}},
+    {7, 4, {1, 3, 7, 13, 13, 15, 69}}
+};
+
+static const int sobol_bits = 32;
+
+// stream of the random numbers of the designs, distinct from the identifiers of the nodes in practice.
+static const uint32_t design_stream = 0x9e3779b9u;
+
+Design::Design(DesignType type, int dimensions, int num_points, uint64_t seed)
+{
+    myType = type;
+    myDimensions = dimensions;
+    myNumPoints = std::max(0, num_points);
+    mySeed = seed;
+    myStrata = 1;
+    myNumCells = 1;
+
+    for(int i=0; i<dimensions; i++)
+    {
+        myKeys.push_back(combineHash(seed, combineHash(design_stream, i)));
+    }
+
+    if(type == DesignType::Stratified && dimensions > 0)
+    {
+        // largest k such that k^d <= n.
+
+        myStrata = std::max(1, int(std::floor(std::pow(double(myNumPoints), 1.0/dimensions) + 1.0e-9)));
+
+        while(myStrata > 1 && std::pow(double(myStrata), double(dimensions)) > double(myNumPoints))
+        {
+            myStrata--;
+        }
+
+        for(int i=0; i<dimensions; i++)
+        {
+            myNumCells *= myStrata;
+        }
+    }
+    else if(type == DesignType::Sobol)
+    {
+        initializeSobol();
+    }
+    else if(type == DesignType::Halton)
+    {
+        initializeHalton();
+    }
+}
+
+int Design::getMaximumDimensions(DesignType type)
+{
+    int ret = 1 << 16;
+
+    if(type == DesignType::Sobol)
+    {
+        ret = 1 + int(sizeof(sobol_polynomials) / sizeof(sobol_polynomials[0]));
+    }
+
+    return ret;
+}
+
+int Design::getDimensions()
+{
+    return myDimensions;
+}
+
+void Design::getPoint(int index, double* point)
+{
+    switch(myType)
+    {
+    case DesignType::Stratified:
+        getStratifiedPoint(index, point);
+        break;
+    case DesignType::LatinHypercube:
+        getLatinHypercubePoint(index, point);
+        break;
+    case DesignType::Sobol:
+        getSobolPoint(index, point);
+        break;
+    case DesignType::Halton:
+        getHaltonPoint(index, point);
+        break;
+    case DesignType::Random:
+    default:
+        getRandomPoint(index, point);
+        break;
+    }
+}
+
+void Design::getRandomPoint(int index, double* point)
+{
+    RandomStream random(mySeed, index, design_stream);
+
+    for(int i=0; i<myDimensions; i++)
+    {
+        point[i] = random.uniform();
+    }
+}
+
+void Design::getStratifiedPoint(int index, double* point)
+{
+    if(uint64_t(index) < myNumCells)
+    {
+        RandomStream random(mySeed, index, design_stream);
+        uint64_t cell = permute(index, myNumCells, myKeys.front());
+
+        for(int i=0; i<myDimensions; i++)
+        {
+            point[i] = (double(cell % myStrata) + random.uniform()) / myStrata;
+            cell /= myStrata;
+        }
+    }
+    else
+    {
+        getRandomPoint(index, point);
+    }
+}
+
+void Design::getLatinHypercubePoint(int index, double* point)
+{
+    if(index < myNumPoints)
+    {
+        RandomStream random(mySeed, index, design_stream);
+
+        for(int i=0; i<myDimensions; i++)
+        {
+            point[i] = (double(permute(index, myNumPoints, myKeys[i])) + random.uniform()) / myNumPoints;
+        }
+    }
+    else
+    {
+        getRandomPoint(index, point);
+    }
+}
+
+void Design::getSobolPoint(int index, double* point)
+{
+    const uint32_t n = uint32_t(index);
+
+    for(int i=0; i<myDimensions; i++)
+    {
+        const uint32_t* directions = myDirections.data() + i*sobol_bits;
+        uint32_t x = uint32_t(myKeys[i]);
+
+        for(int b=0; b<sobol_bits && (n >> b) != 0; b++)
+        {
+            if((n >> b) & 1)
+            {
+                x ^= directions[b];
+            }
+        }
+
+        point[i] = (double(x) + 0.5) * (1.0 / 4294967296.0);
+    }
+}
+
+void Design::getHaltonPoint(int index, double* point)
+{
+    // the first point of the sequence is skipped, as it is zero in all the dimensions.
+
+    for(int i=0; i<myDimensions; i++)
+    {
+        const uint32_t base = myPrimes[i];
+        uint64_t n = uint64_t(index) + 1;
+        double factor = 1.0 / base;
+        double x = 0.0;
+
+        while(n > 0)
+        {
+            x += factor * double(n % base);
+            n /= base;
+            factor /= base;
+        }
+
+        x += double(myKeys[i] >> 11) * (1.0 / 9007199254740992.0);
+
+        point[i] = x - std::floor(x);
+    }
+}
+
+void Design::initializeSobol()
+{
+    myDirections.assign(size_t(myDimensions) * sobol_bits, 0);
+
+    for(int i=0; i<myDimensions && i<getMaximumDimensions(DesignType::Sobol); i++)
+    {
+        uint32_t* v = myDirections.data() + i*sobol_bits;
+
+        if(i == 0)
+        {
+            for(int b=0; b<sobol_bits; b++)
+            {
+                v[b] = 1u << (sobol_bits-1-b);
+            }
+        }
+        else
+        {
+            const SobolPolynomial& polynomial = sobol_polynomials[i-1];
+            const int s = polynomial.s;
+
+            for(int b=0; b<s; b++)
+            {
+                v[b] = polynomial.m[b] << (sobol_bits-1-b);
+            }
+
+            for(int b=s; b<sobol_bits; b++)
+            {
+                v[b] = v[b-s] ^ (v[b-s] >> s);
+
+                for(int k=1; k<s; k++)
+                {
+                    v[b] ^= ((polynomial.a >> (s-1-k)) & 1) * v[b-k];
+                }
+            }
+        }
+    }
+}
+
+void Design::initializeHalton()
+{
+    uint32_t candidate = 2;
+
+    while(myPrimes.size() < size_t(myDimensions))
+    {
+        bool prime = true;
+
+        for(size_t i=0; prime && i<myPrimes.size() && myPrimes[i]*myPrimes[i] <= candidate; i++)
+        {
+            prime = (candidate % myPrimes[i] != 0);
+        }
+
+        if(prime)
+        {
+            myPrimes.push_back(candidate);
+        }
+
+        candidate++;
+    }
+}
+
+uint64_t Design::permute(uint64_t index, uint64_t size, uint64_t key)
+{
+    // Feistel network on the smallest domain of 4^k elements covering [0,size). Indices falling
+    // outside of [0,size) are permuted again until they come back, which terminates since the network is a bijection.
+
+    int half = 1;
+
+    while((uint64_t(1) << (2*half)) < size)
+    {
+        half++;
+    }
+
+    const uint64_t mask = (uint64_t(1) << half) - 1;
+
+    do
+    {
+        uint64_t left = index >> half;
+        uint64_t right = index & mask;
+
+        for(uint64_t round=0; round<4; round++)
+        {
+            const uint64_t next = left ^ (combineHash(key + round, right) & mask);
+            left = right;
+            right = next;
+        }
+
+        index = (left << half) | right;
+    }
+    while(index >= size);
+
+    return index;
+}
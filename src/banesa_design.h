@@ -0,0 +1,74 @@
+
+#pragma once
+
+#include "banesa_core.h"
+
+enum class DesignType
+{
+    // independent uniform points.
+    Random,
+
+    // one point per cell of a regular grid of k^d cells, k being the largest integer such that k^d <= number of points.
+    // Cells are visited in a pseudo-random order and the points in excess are random.
+    Stratified,
+
+    // each of the n intervals [i/n, (i+1)/n) of each coordinate holds exactly one point. Points beyond n are random.
+    LatinHypercube,
+
+    // Sobol sequence with the direction numbers of Joe and Kuo, randomized by a digital shift.
+    Sobol,
+
+    // Halton sequence, randomized by a shift modulo one.
+    Halton
+};
+
+// Points in [0,1)^d given to the nodes which declare design dimensions (see Node::setDesignDimensions()).
+// The point of a sample only depends on the type, on the number of points, on the seed and on the index of the sample,
+// hence it does not depend on the threads, shards or processes which compute the samples.
+
+class Design
+{
+public:
+
+    Design(DesignType type, int dimensions, int num_points, uint64_t seed);
+
+    // largest number of dimensions supported by the type of design.
+    static int getMaximumDimensions(DesignType type);
+
+    int getDimensions();
+
+    void getPoint(int index, double* point);
+
+private:
+
+    void getRandomPoint(int index, double* point);
+
+    void getStratifiedPoint(int index, double* point);
+
+    void getLatinHypercubePoint(int index, double* point);
+
+    void getSobolPoint(int index, double* point);
+
+    void getHaltonPoint(int index, double* point);
+
+    void initializeSobol();
+
+    void initializeHalton();
+
+    // random permutation of [0,size).
+    static uint64_t permute(uint64_t index, uint64_t size, uint64_t key);
+
+private:
+
+    DesignType myType;
+    int myDimensions;
+    int myNumPoints;
+    uint64_t mySeed;
+    std::vector<uint64_t> myKeys;
+    int myStrata;
+    uint64_t myNumCells;
+    std::vector<uint32_t> myDirections;
+    std::vector<uint32_t> myPrimes;
+};
+
+using DesignPtr = std::shared_ptr<Design>;
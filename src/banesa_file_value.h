@@ -1,7 +1,62 @@
 
 #pragma once
 
+#include <fstream>
+#include <iterator>
+#include <type_traits>
 #include "banesa_core.h"
+#include "banesa_payload_writer.h"
+
+struct DefaultFileValueSerializer
+{
+};
+
+// Encodes the payload of a FileValue<T>. Specialize it to let the sampler save the payloads
+// on its I/O threads, so that nodes do not have to write files themselves. For example:
+//
+//   template<>
+//   struct FileValueSerializer<MyImage>
+//   {
+//       static bool encode(const MyImage& image, std::vector<char>& buffer);
+//   };
+//
+// The specialization may also provide the inverse, which lets incremental re-evaluation read the files back
+// (see Sampler::runIncremental()). Without it, the nodes of the values are computed again.
+//
+//       static bool decode(const std::vector<char>& buffer, MyImage& image);
+
+template<typename T>
+struct FileValueSerializer : public DefaultFileValueSerializer
+{
+    static bool encode(const T& value, std::vector<char>& buffer)
+    {
+        return false;
+    }
+};
+
+// Whether FileValueSerializer<T> provides decode().
+
+template<typename T, typename Enable=void>
+struct FileValueDecoder
+{
+    static const bool supported = false;
+
+    static bool decode(const std::vector<char>& buffer, T& value)
+    {
+        return false;
+    }
+};
+
+template<typename T>
+struct FileValueDecoder<T, decltype(void(FileValueSerializer<T>::decode(std::declval<const std::vector<char>&>(), std::declval<T&>())))>
+{
+    static const bool supported = true;
+
+    static bool decode(const std::vector<char>& buffer, T& value)
+    {
+        return FileValueSerializer<T>::decode(buffer, value);
+    }
+};
 
 template<typename T>
 class FileValue : public Value
@@ -17,17 +72,80 @@ public:
         return myValue;
     }
 
+    const T& ref() const
+    {
+        return myValue;
+    }
+
+    size_t getMemorySize() const override
+    {
+        return sizeof(FileValue<T>) - sizeof(T) + MemorySize<T>::get(myValue) + myPath.capacity();
+    }
+
     void setPath(const std::string& path)
     {
         myPath = path;
     }
 
-    void bind(sqlite3_stmt* stmt, int& offset) override
+    const std::string& getPath() const
     {
-        sqlite3_bind_text(stmt, offset, myPath.c_str(), -1, SQLITE_TRANSIENT);
+        return myPath;
+    }
+
+    void write(FieldWriter& writer, int& offset) override
+    {
+        writer.writeText(offset, myPath);
         offset++;
     }
 
+    bool read(FieldReader& reader, int& offset) override
+    {
+        bool ok = FileValueDecoder<T>::supported;
+
+        if(ok)
+        {
+            ok = reader.readText(offset, myPath);
+        }
+
+        if(ok && myPath.empty() == false)
+        {
+            std::ifstream file(myPath, std::ios::binary);
+            ok = file.is_open();
+
+            if(ok)
+            {
+                const std::vector<char> buffer( (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>() );
+                ok = FileValueDecoder<T>::decode(buffer, myValue);
+            }
+        }
+
+        offset++;
+
+        return ok;
+    }
+
+    bool savePayload(PayloadContext& context) override
+    {
+        bool ok = true;
+        std::vector<char>& buffer = context.refBuffer();
+
+        buffer.clear();
+
+        // without a path there is nothing to save, but a value which cannot be encoded fails the batch.
+
+        if(myPath.empty() == false)
+        {
+            ok = FileValueSerializer<T>::encode(myValue, buffer);
+        }
+
+        if(ok && myPath.empty() == false)
+        {
+            ok = context.writeFile(myPath, buffer);
+        }
+
+        return ok;
+    }
+
 protected:
 
     std::string myPath;
@@ -43,20 +161,19 @@ public:
     {
     }
 
-    void getSqlFieldNames(std::vector<std::string>& names) override
+    void getFields(std::vector<Field>& fields) override
     {
-        const std::string field_name = getName() + "_path";
-        names.assign({ field_name });
+        fields.assign({ Field{getName() + "_path", FieldType::Text} });
     }
 
-    void getSqlFieldTypes(std::vector<std::string>& sqltypes) override
+    ValuePtr createValue() override
     {
-        sqltypes.assign({"TEXT"});
+        return std::make_shared< FileValue<T> >(shared_from_this());
     }
 
-    ValuePtr createValue() override
+    bool hasPayload() override
     {
-        return std::make_shared< FileValue<T> >(shared_from_this());
+        return (std::is_base_of< DefaultFileValueSerializer, FileValueSerializer<T> >::value == false);
     }
 };
 
@@ -17,7 +17,37 @@ public:
         return myValue;
     }
 
-    void bind(sqlite3_stmt* stmt, int& offset) override
+    const T& ref() const
+    {
+        return myValue;
+    }
+
+    size_t getMemorySize() const override
+    {
+        return sizeof(HiddenValue<T>) - sizeof(T) + MemorySize<T>::get(myValue);
+    }
+
+    bool isComparable() const override
+    {
+        return ValueContent<T>::supported;
+    }
+
+    uint64_t getHash() const override
+    {
+        return ValueContent<T>::hash(myValue);
+    }
+
+    bool isEqual(const Value& other) const override
+    {
+        return ValueContent<T>::equal(myValue, static_cast<const HiddenValue<T>&>(other).ref());
+    }
+
+    void assign(const Value& other) override
+    {
+        ValueContent<T>::copy(static_cast<const HiddenValue<T>&>(other).ref(), myValue);
+    }
+
+    void write(FieldWriter& writer, int& offset) override
     {
     }
 
@@ -35,14 +65,9 @@ public:
     {
     }
 
-    void getSqlFieldNames(std::vector<std::string>& names) override
-    {
-        names.clear();
-    }
-
-    void getSqlFieldTypes(std::vector<std::string>& sqltypes) override
+    void getFields(std::vector<Field>& fields) override
     {
-        sqltypes.clear();
+        fields.clear();
     }
 
     ValuePtr createValue() override
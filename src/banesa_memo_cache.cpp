@@ -0,0 +1,187 @@
+#include <algorithm>
+#include "banesa_memo_cache.h"
+
+MemoCache::MemoCache(size_t capacity, int num_shards)
+{
+    num_shards = std::max(1, num_shards);
+
+    myShardCapacity = capacity / num_shards;
+    myHits = 0;
+    myMisses = 0;
+
+    for(int i=0; i<num_shards; i++)
+    {
+        myShards.emplace_back(new Shard());
+        myShards.back()->memory_size = 0;
+    }
+}
+
+uint64_t MemoCache::getKey(uint32_t node, const ValueSpan& input)
+{
+    uint64_t ret = combineHash(0, node);
+
+    for(const ValuePtr& value : input)
+    {
+        ret = combineHash(ret, value->getHash());
+    }
+
+    return ret;
+}
+
+bool MemoCache::load(uint64_t key, uint32_t node, const ValueSpan& input, const ValueSpan& output)
+{
+    Shard& shard = refShard(key);
+    EntryPtr entry;
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto range = shard.index.equal_range(key);
+
+        for(auto it=range.first; entry == nullptr && it!=range.second; it++)
+        {
+            if(isMatch(**it->second, node, input))
+            {
+                entry = *it->second;
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            }
+        }
+    }
+
+    // entries are immutable, hence the outputs are copied outside of the lock.
+
+    if(entry)
+    {
+        for(size_t i=0; i<output.size(); i++)
+        {
+            output[i]->assign(*entry->outputs[i]);
+        }
+
+        myHits++;
+    }
+    else
+    {
+        myMisses++;
+    }
+
+    return (entry != nullptr);
+}
+
+void MemoCache::store(uint64_t key, uint32_t node, const ValueSpan& input, const ValueSpan& output)
+{
+    Shard& shard = refShard(key);
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+
+    entry->node = node;
+    entry->key = key;
+    entry->memory_size = sizeof(Entry);
+
+    copyValues(input, entry->inputs, entry->memory_size);
+    copyValues(output, entry->outputs, entry->memory_size);
+
+    if(entry->memory_size <= myShardCapacity)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // another worker may have stored the same inputs meanwhile.
+
+        bool found = false;
+        auto range = shard.index.equal_range(key);
+
+        for(auto it=range.first; found == false && it!=range.second; it++)
+        {
+            found = isMatch(**it->second, node, input);
+        }
+
+        if(found == false)
+        {
+            shard.entries.push_front(entry);
+            shard.index.insert(std::make_pair(key, shard.entries.begin()));
+            shard.memory_size += entry->memory_size;
+        }
+
+        while(shard.memory_size > myShardCapacity)
+        {
+            const EntryPtr& last = shard.entries.back();
+            auto it = shard.index.find(last->key);
+
+            while(*it->second != last)
+            {
+                it++;
+            }
+
+            shard.memory_size -= last->memory_size;
+            shard.index.erase(it);
+            shard.entries.pop_back();
+        }
+    }
+}
+
+void MemoCache::clear()
+{
+    for(std::unique_ptr<Shard>& shard : myShards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        shard->entries.clear();
+        shard->index.clear();
+        shard->memory_size = 0;
+    }
+
+    myHits = 0;
+    myMisses = 0;
+}
+
+size_t MemoCache::getHits()
+{
+    return myHits;
+}
+
+size_t MemoCache::getMisses()
+{
+    return myMisses;
+}
+
+size_t MemoCache::getMemorySize()
+{
+    size_t ret = 0;
+
+    for(std::unique_ptr<Shard>& shard : myShards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        ret += shard->memory_size;
+    }
+
+    return ret;
+}
+
+MemoCache::Shard& MemoCache::refShard(uint64_t key)
+{
+    // the low bits of the key select the bucket in the shard, hence the high bits select the shard.
+
+    return *myShards[(key >> 40) % myShards.size()];
+}
+
+bool MemoCache::isMatch(const Entry& entry, uint32_t node, const ValueSpan& input)
+{
+    bool ret = (entry.node == node && entry.inputs.size() == input.size());
+
+    for(size_t i=0; ret && i<input.size(); i++)
+    {
+        ret = entry.inputs[i]->isEqual(*input[i]);
+    }
+
+    return ret;
+}
+
+void MemoCache::copyValues(const ValueSpan& values, std::vector<ValuePtr>& copies, size_t& memory_size)
+{
+    copies.resize(values.size());
+
+    for(size_t i=0; i<values.size(); i++)
+    {
+        copies[i] = values[i]->getFactory()->createValue();
+        copies[i]->assign(*values[i]);
+        memory_size += copies[i]->getMemorySize();
+    }
+}
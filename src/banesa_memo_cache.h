@@ -0,0 +1,76 @@
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "banesa_core.h"
+
+// Outputs of pure nodes (see Node::setPure()) indexed by the content of their inputs.
+// Entries are spread over shards, each with its own lock and least recently used list, so that workers rarely contend.
+// The size of the cache is bounded using the memory reported by the values (see Value::getMemorySize()).
+// A cache may be shared by several runs, provided that nodes with the same name compute the same function.
+// The methods may be called concurrently.
+
+class MemoCache
+{
+public:
+
+    MemoCache(size_t capacity, int num_shards=16);
+
+    static uint64_t getKey(uint32_t node, const ValueSpan& input);
+
+    // Copies the outputs stored for the given inputs. Returns false if there is none.
+    bool load(uint64_t key, uint32_t node, const ValueSpan& input, const ValueSpan& output);
+
+    // Stores a copy of the inputs and outputs, evicting the least recently used entries if needed.
+    void store(uint64_t key, uint32_t node, const ValueSpan& input, const ValueSpan& output);
+
+    void clear();
+
+    size_t getHits();
+
+    size_t getMisses();
+
+    size_t getMemorySize();
+
+private:
+
+    struct Entry
+    {
+        uint32_t node;
+        uint64_t key;
+        std::vector<ValuePtr> inputs;
+        std::vector<ValuePtr> outputs;
+        size_t memory_size;
+    };
+
+    using EntryPtr = std::shared_ptr<const Entry>;
+    using EntryList = std::list<EntryPtr>;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        EntryList entries;
+        std::unordered_multimap<uint64_t, EntryList::iterator> index;
+        size_t memory_size;
+    };
+
+private:
+
+    Shard& refShard(uint64_t key);
+
+    static bool isMatch(const Entry& entry, uint32_t node, const ValueSpan& input);
+
+    static void copyValues(const ValueSpan& values, std::vector<ValuePtr>& copies, size_t& memory_size);
+
+private:
+
+    size_t myShardCapacity;
+    std::vector< std::unique_ptr<Shard> > myShards;
+    std::atomic<size_t> myHits;
+    std::atomic<size_t> myMisses;
+};
+
+using MemoCachePtr = std::shared_ptr<MemoCache>;
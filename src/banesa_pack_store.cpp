@@ -0,0 +1,439 @@
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "banesa_pack_store.h"
+
+static const char pack_magic[8] = { 'B', 'N', 'S', 'P', 'A', 'K', '0', '1' };
+
+PackStore::PackStore(const std::string& prefix, int64_t segment_size)
+{
+    myPrefix = prefix;
+    mySegmentSize = segment_size;
+    myDeduplication = false;
+    myFailed = false;
+    myFirstPack = -1;
+}
+
+PackStore::~PackStore()
+{
+    close();
+}
+
+void PackStore::setDeduplication(bool deduplication)
+{
+    myDeduplication = deduplication;
+}
+
+bool PackStore::store(const std::vector<char>& buffer, PackLocation& location)
+{
+    bool ok = true;
+    bool found = false;
+    std::vector<PackLocation> candidates;
+    Segment* segment = nullptr;
+    int fd = -1;
+
+    location.pack = 0;
+    location.offset = 0;
+    location.length = buffer.size();
+    location.hash = hash(buffer.data(), buffer.size());
+
+    // look for an identical payload.
+
+    if(myDeduplication)
+    {
+        {
+            std::lock_guard<std::mutex> lock(myMutex);
+
+            auto range = myIndex.equal_range(location.hash);
+
+            for(auto it=range.first; it!=range.second; it++)
+            {
+                if(it->second.length == location.length)
+                {
+                    candidates.push_back(it->second);
+                }
+            }
+        }
+
+        for(size_t i=0; found == false && i<candidates.size(); i++)
+        {
+            found = isStored(buffer, candidates[i]);
+
+            if(found)
+            {
+                location = candidates[i];
+            }
+        }
+    }
+
+    // reserve space at the end of the current segment.
+
+    if(found == false)
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+
+        ok = (myFailed == false);
+
+        if(ok && (mySegments.empty() || (mySegments.back().size > int64_t(sizeof(pack_magic)) && mySegments.back().size + location.length > mySegmentSize)))
+        {
+            ok = openSegment();
+        }
+
+        if(ok)
+        {
+            segment = &mySegments.back();
+            fd = segment->fd;
+            location.pack = myFirstPack + mySegments.size() - 1;
+            location.offset = segment->size;
+            segment->size += location.length;
+            segment->dirty = true;
+        }
+    }
+
+    // write outside of the lock, so that several payloads are written concurrently.
+
+    if(ok && found == false)
+    {
+        size_t written = 0;
+
+        while(ok && written < buffer.size())
+        {
+            const ssize_t ret = pwrite(fd, buffer.data() + written, buffer.size() - written, location.offset + written);
+            ok = (ret > 0 || (ret < 0 && errno == EINTR));
+
+            if(ret > 0)
+            {
+                written += ret;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(myMutex);
+
+        if(ok && myDeduplication)
+        {
+            myIndex.insert(std::make_pair(location.hash, location));
+        }
+        else if(ok == false)
+        {
+            myFailed = true;
+        }
+    }
+
+    return ok;
+}
+
+bool PackStore::sync()
+{
+    bool ok = true;
+    std::vector<int> fds;
+
+    // the sync mutex guarantees that payloads found by deduplication are durable when sync() returns,
+    // even if another thread is syncing the segment they belong to.
+
+    std::lock_guard<std::mutex> sync_lock(mySyncMutex);
+
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+
+        ok = (myFailed == false);
+
+        for(Segment& segment : mySegments)
+        {
+            if(segment.dirty)
+            {
+                fds.push_back(segment.fd);
+                segment.dirty = false;
+            }
+        }
+    }
+
+    for(size_t i=0; ok && i<fds.size(); i++)
+    {
+        ok = (fsync(fds[i]) == 0);
+    }
+
+    return ok;
+}
+
+bool PackStore::close()
+{
+    bool ok = sync();
+
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    for(Segment& segment : mySegments)
+    {
+        if(::close(segment.fd) != 0)
+        {
+            ok = false;
+        }
+    }
+
+    mySegments.clear();
+    myIndex.clear();
+    myFirstPack = -1;
+
+    return ok;
+}
+
+std::string PackStore::getSegmentPath(const std::string& prefix, int64_t pack)
+{
+    return prefix + "." + std::to_string(pack) + ".pack";
+}
+
+uint64_t PackStore::hash(const char* data, size_t size)
+{
+    // MurmurHash64A.
+
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    const char* end = data + (size / 8) * 8;
+    uint64_t h = 0x42u ^ (size * m);
+
+    for( ; data != end; data += 8)
+    {
+        uint64_t k = 0;
+        std::memcpy(&k, data, 8);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = reinterpret_cast<const unsigned char*>(data);
+
+    switch(size & 7)
+    {
+    case 7: h ^= uint64_t(tail[6]) << 48;
+            // fall through
+    case 6: h ^= uint64_t(tail[5]) << 40;
+            // fall through
+    case 5: h ^= uint64_t(tail[4]) << 32;
+            // fall through
+    case 4: h ^= uint64_t(tail[3]) << 24;
+            // fall through
+    case 3: h ^= uint64_t(tail[2]) << 16;
+            // fall through
+    case 2: h ^= uint64_t(tail[1]) << 8;
+            // fall through
+    case 1: h ^= uint64_t(tail[0]);
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+bool PackStore::openSegment()
+{
+    bool ok = true;
+    Segment segment;
+
+    // new segments are created after the existing ones.
+
+    if(myFirstPack < 0)
+    {
+        struct stat info;
+
+        myFirstPack = 0;
+
+        while(stat(getSegmentPath(myPrefix, myFirstPack).c_str(), &info) == 0)
+        {
+            myFirstPack++;
+        }
+    }
+
+    const std::string path = getSegmentPath(myPrefix, myFirstPack + mySegments.size());
+
+    segment.fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    segment.size = sizeof(pack_magic);
+    segment.dirty = true;
+
+    ok = (segment.fd >= 0);
+
+    if(ok)
+    {
+        ok = (pwrite(segment.fd, pack_magic, sizeof(pack_magic), 0) == ssize_t(sizeof(pack_magic)));
+
+        if(ok)
+        {
+            mySegments.push_back(segment);
+        }
+        else
+        {
+            ::close(segment.fd);
+        }
+    }
+
+    if(ok == false)
+    {
+        myFailed = true;
+    }
+
+    return ok;
+}
+
+bool PackStore::isStored(const std::vector<char>& buffer, const PackLocation& location)
+{
+    bool ret = true;
+    int fd = -1;
+    std::vector<char> stored(buffer.size());
+    size_t offset = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        fd = mySegments[location.pack - myFirstPack].fd;
+    }
+
+    while(ret && offset < stored.size())
+    {
+        const ssize_t count = pread(fd, stored.data() + offset, stored.size() - offset, location.offset + offset);
+        ret = (count > 0);
+
+        if(ret)
+        {
+            offset += count;
+        }
+    }
+
+    return ret && (stored == buffer);
+}
+
+PackReader::PackReader(const std::string& prefix)
+{
+    myPrefix = prefix;
+}
+
+PackReader::~PackReader()
+{
+    close();
+}
+
+bool PackReader::getPayload(const PackLocation& location, const char*& data, size_t& size, bool verify)
+{
+    bool ok = (location.pack >= 0 && location.offset >= 0 && location.length >= 0);
+    Mapping mapping{nullptr, 0};
+
+    if(ok)
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+
+        ok = mapSegment(location.pack, uint64_t(location.offset) + uint64_t(location.length));
+
+        if(ok)
+        {
+            mapping = myMappings[location.pack];
+        }
+    }
+
+    if(ok)
+    {
+        ok = (uint64_t(location.offset) + uint64_t(location.length) <= mapping.size);
+    }
+
+    if(ok)
+    {
+        data = mapping.data + location.offset;
+        size = location.length;
+    }
+
+    if(ok && verify)
+    {
+        ok = (PackStore::hash(data, size) == location.hash);
+    }
+
+    return ok;
+}
+
+void PackReader::close()
+{
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    for(Mapping& mapping : myMappings)
+    {
+        if(mapping.data != nullptr)
+        {
+            munmap(const_cast<char*>(mapping.data), mapping.size);
+        }
+    }
+
+    for(Mapping& mapping : myOldMappings)
+    {
+        munmap(const_cast<char*>(mapping.data), mapping.size);
+    }
+
+    myMappings.clear();
+    myOldMappings.clear();
+}
+
+bool PackReader::mapSegment(int64_t pack, uint64_t end)
+{
+    bool ok = true;
+    int fd = -1;
+    struct stat info;
+    void* data = nullptr;
+
+    // a segment may still be appended to by a store, after it was mapped.
+
+    const bool mapped = (pack < int64_t(myMappings.size()) && myMappings[pack].data != nullptr && end <= myMappings[pack].size);
+
+    if(mapped == false)
+    {
+        fd = open(PackStore::getSegmentPath(myPrefix, pack).c_str(), O_RDONLY | O_CLOEXEC);
+        ok = (fd >= 0);
+
+        if(ok)
+        {
+            ok = (fstat(fd, &info) == 0 && info.st_size >= off_t(sizeof(pack_magic)) && uint64_t(info.st_size) >= end);
+        }
+
+        if(ok)
+        {
+            data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ok = (data != MAP_FAILED);
+        }
+
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+
+        if(ok)
+        {
+            ok = (std::memcmp(data, pack_magic, sizeof(pack_magic)) == 0);
+
+            if(ok)
+            {
+                if(pack >= int64_t(myMappings.size()))
+                {
+                    myMappings.resize(pack+1, Mapping{nullptr, 0});
+                }
+
+                // payloads returned earlier still point into the previous mapping.
+
+                if(myMappings[pack].data != nullptr)
+                {
+                    myOldMappings.push_back(myMappings[pack]);
+                }
+
+                myMappings[pack] = Mapping{ static_cast<const char*>(data), size_t(info.st_size) };
+            }
+            else
+            {
+                munmap(data, info.st_size);
+            }
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,110 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+// Location of a payload in the segments of a pack store.
+
+struct PackLocation
+{
+    int64_t pack;
+    int64_t offset;
+    int64_t length;
+    uint64_t hash;
+};
+
+// Storage of many payloads in a few large segment files <prefix>.<k>.pack, each starting with the magic "BNSPAK01".
+// Payloads are appended and optionally deduplicated by content (MurmurHash64A, then byte comparison).
+// Deduplication only applies to payloads stored by the same instance. Segments which already exist
+// are never modified, new segments being created after them.
+// The methods may be called concurrently.
+
+class PackStore
+{
+public:
+
+    PackStore(const std::string& prefix, int64_t segment_size=(int64_t(1) << 30));
+
+    ~PackStore();
+
+    void setDeduplication(bool deduplication);
+
+    // The payload is not durable before sync() returns.
+    bool store(const std::vector<char>& buffer, PackLocation& location);
+
+    bool sync();
+
+    bool close();
+
+    static std::string getSegmentPath(const std::string& prefix, int64_t pack);
+
+    static uint64_t hash(const char* data, size_t size);
+
+private:
+
+    struct Segment
+    {
+        int fd;
+        int64_t size;
+        bool dirty;
+    };
+
+private:
+
+    bool openSegment();
+
+    bool isStored(const std::vector<char>& buffer, const PackLocation& location);
+
+private:
+
+    std::string myPrefix;
+    int64_t mySegmentSize;
+    bool myDeduplication;
+    bool myFailed;
+    int64_t myFirstPack;
+    std::vector<Segment> mySegments;
+    std::unordered_multimap<uint64_t, PackLocation> myIndex;
+    std::mutex myMutex;
+    std::mutex mySyncMutex;
+};
+
+// Read access to the payloads of a pack store. Segments are memory mapped, hence payloads are not copied.
+// A segment which grew since it was mapped is mapped again; the previous mapping is kept until the reader is closed.
+
+class PackReader
+{
+public:
+
+    PackReader(const std::string& prefix);
+
+    ~PackReader();
+
+    // The data remains valid until the reader is closed. If verify is true, the hash of the payload is checked.
+    bool getPayload(const PackLocation& location, const char*& data, size_t& size, bool verify=false);
+
+    void close();
+
+private:
+
+    struct Mapping
+    {
+        const char* data;
+        size_t size;
+    };
+
+private:
+
+    // maps the segment if it is not mapped yet, or if its mapping ends before end.
+    bool mapSegment(int64_t pack, uint64_t end);
+
+private:
+
+    std::string myPrefix;
+    std::vector<Mapping> myMappings;
+    std::vector<Mapping> myOldMappings;
+    std::mutex myMutex;
+};
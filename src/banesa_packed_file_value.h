@@ -0,0 +1,109 @@
+
+#pragma once
+
+#include "banesa_core.h"
+#include "banesa_file_value.h"
+#include "banesa_pack_store.h"
+#include "banesa_payload_writer.h"
+
+// Same as FileValue but the payload is appended to a pack store instead of being saved to its own file.
+// The database stores the location of the payload, which can be read back with a PackReader.
+// FileValueSerializer<T> must be specialized. Payloads are not read back by incremental re-evaluation, which computes the node again.
+
+template<typename T>
+class PackedFileValue : public Value
+{
+public:
+
+    static_assert(std::is_base_of< DefaultFileValueSerializer, FileValueSerializer<T> >::value == false, "FileValueSerializer must be specialized!");
+
+    PackedFileValue(ValueFactoryPtr factory, std::shared_ptr<PackStore> store) : Value(factory), myStore(std::move(store))
+    {
+        myLocation = PackLocation{0, 0, 0, 0};
+    }
+
+    T& ref()
+    {
+        return myValue;
+    }
+
+    const T& ref() const
+    {
+        return myValue;
+    }
+
+    size_t getMemorySize() const override
+    {
+        return sizeof(PackedFileValue<T>) - sizeof(T) + MemorySize<T>::get(myValue);
+    }
+
+    const PackLocation& getLocation() const
+    {
+        return myLocation;
+    }
+
+    void write(FieldWriter& writer, int& offset) override
+    {
+        writer.writeInteger(offset+0, myLocation.pack);
+        writer.writeInteger(offset+1, myLocation.offset);
+        writer.writeInteger(offset+2, myLocation.length);
+        writer.writeInteger(offset+3, int64_t(myLocation.hash));
+        offset += 4;
+    }
+
+    bool savePayload(PayloadContext& context) override
+    {
+        bool ok = true;
+        std::vector<char>& buffer = context.refBuffer();
+
+        buffer.clear();
+
+        ok = FileValueSerializer<T>::encode(myValue, buffer);
+
+        if(ok)
+        {
+            ok = context.writePack(*myStore, buffer, myLocation);
+        }
+
+        return ok;
+    }
+
+protected:
+
+    std::shared_ptr<PackStore> myStore;
+    PackLocation myLocation;
+    T myValue;
+};
+
+template<typename T>
+class PackedFileValueFactory : public ValueFactory
+{
+public:
+
+    PackedFileValueFactory(const std::string& name, std::shared_ptr<PackStore> store) : ValueFactory(name), myStore(std::move(store))
+    {
+    }
+
+    void getFields(std::vector<Field>& fields) override
+    {
+        fields.clear();
+        fields.push_back( Field{getName() + "_pack", FieldType::Integer} );
+        fields.push_back( Field{getName() + "_offset", FieldType::Integer} );
+        fields.push_back( Field{getName() + "_length", FieldType::Integer} );
+        fields.push_back( Field{getName() + "_hash", FieldType::Integer} );
+    }
+
+    ValuePtr createValue() override
+    {
+        return std::make_shared< PackedFileValue<T> >(shared_from_this(), myStore);
+    }
+
+    bool hasPayload() override
+    {
+        return true;
+    }
+
+protected:
+
+    std::shared_ptr<PackStore> myStore;
+};
@@ -0,0 +1,235 @@
+
+#include <set>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "banesa_payload_writer.h"
+
+PayloadWriter::PayloadWriter()
+{
+    myCompiledGraph = nullptr;
+    myRunStats = nullptr;
+    myStopping = false;
+}
+
+PayloadWriter::~PayloadWriter()
+{
+    stop();
+}
+
+void PayloadWriter::setRunStats(RunStats* stats)
+{
+    myRunStats = stats;
+}
+
+void PayloadWriter::start(CompiledGraph* compiled_graph, int num_threads, std::function<void(SampleBatch*)> callback)
+{
+    myCompiledGraph = compiled_graph;
+    myCallback = std::move(callback);
+    myStopping = false;
+
+    for(int i=0; i<num_threads; i++)
+    {
+        myThreads.emplace_back([this] () { run(); });
+    }
+}
+
+void PayloadWriter::push(SampleBatch* batch)
+{
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myQueue.push_back(batch);
+    }
+
+    myCondition.notify_one();
+}
+
+void PayloadWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myStopping = true;
+    }
+
+    myCondition.notify_all();
+
+    for(std::thread& t : myThreads)
+    {
+        t.join();
+    }
+
+    myThreads.clear();
+}
+
+void PayloadWriter::run()
+{
+    PayloadContext context;
+
+    while(true)
+    {
+        SampleBatch* batch = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(myMutex);
+
+            myCondition.wait(lock, [this] () { return myStopping || myQueue.empty() == false; });
+
+            if(myQueue.empty())
+            {
+                break;
+            }
+
+            batch = myQueue.front();
+            myQueue.pop_front();
+        }
+
+        const uint64_t start = (myRunStats != nullptr) ? RunStats::getTime() : 0;
+
+        if(save(myCompiledGraph, *batch, context) == false)
+        {
+            batch->failed = true;
+        }
+
+        if(myRunStats != nullptr)
+        {
+            myRunStats->addPayload(batch->size, RunStats::getTime() - start);
+        }
+
+        myCallback(batch);
+    }
+}
+
+bool PayloadWriter::save(CompiledGraph* compiled_graph, SampleBatch& batch, PayloadContext& context)
+{
+    bool ok = true;
+
+    for(size_t i=0; ok && i<batch.size; i++)
+    {
+        const SampleRecord& record = batch.records[i];
+
+        for(size_t j=0; ok && j<compiled_graph->refPayloadValues().size(); j++)
+        {
+            const size_t index = compiled_graph->refPayloadValues()[j];
+
+            // values shared by consecutive records (fan-out) are saved once.
+
+            if(i == 0 || batch.records[i-1].values[index] != record.values[index])
+            {
+                ok = record.values[index]->savePayload(context);
+            }
+        }
+    }
+
+    if(ok)
+    {
+        ok = context.sync();
+    }
+
+    return ok;
+}
+
+bool PayloadContext::writeFile(const std::string& path, const std::vector<char>& buffer)
+{
+    const std::string tmp_path = path + ".tmp";
+    bool ok = true;
+    int fd = -1;
+    size_t written = 0;
+
+    if(ok)
+    {
+        fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ok = (fd >= 0);
+    }
+
+    while(ok && written < buffer.size())
+    {
+        const ssize_t ret = ::write(fd, buffer.data() + written, buffer.size() - written);
+        ok = (ret > 0 || (ret < 0 && errno == EINTR));
+
+        if(ret > 0)
+        {
+            written += ret;
+        }
+    }
+
+    if(ok)
+    {
+        ok = (fsync(fd) == 0);
+    }
+
+    if(fd >= 0 && close(fd) != 0)
+    {
+        ok = false;
+    }
+
+    if(ok)
+    {
+        ok = (std::rename(tmp_path.c_str(), path.c_str()) == 0);
+    }
+
+    // the temporary file is not left behind, whichever step failed after its creation.
+
+    if(ok == false && fd >= 0)
+    {
+        std::remove(tmp_path.c_str());
+    }
+
+    if(ok)
+    {
+        const size_t slash = path.find_last_of('/');
+        myDirectories.insert( (slash == std::string::npos) ? std::string(".") : path.substr(0, slash+1) );
+    }
+
+    return ok;
+}
+
+bool PayloadContext::writePack(PackStore& store, const std::vector<char>& buffer, PackLocation& location)
+{
+    const bool ok = store.store(buffer, location);
+
+    if(ok)
+    {
+        myPackStores.insert(&store);
+    }
+
+    return ok;
+}
+
+bool PayloadContext::sync()
+{
+    bool ok = true;
+
+    // renames are made durable once per directory.
+
+    for(std::set<std::string>::iterator it=myDirectories.begin(); ok && it!=myDirectories.end(); it++)
+    {
+        ok = syncDirectory(*it);
+    }
+
+    for(std::set<PackStore*>::iterator it=myPackStores.begin(); ok && it!=myPackStores.end(); it++)
+    {
+        ok = (*it)->sync();
+    }
+
+    myDirectories.clear();
+    myPackStores.clear();
+
+    return ok;
+}
+
+bool PayloadContext::syncDirectory(const std::string& path)
+{
+    bool ok = true;
+    const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    ok = (fd >= 0);
+
+    if(ok)
+    {
+        ok = (fsync(fd) == 0);
+        close(fd);
+    }
+
+    return ok;
+}
@@ -0,0 +1,82 @@
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <set>
+#include "banesa_compiled_graph.h"
+#include "banesa_pack_store.h"
+
+// Used by values to save their payloads. Files and pack stores written to are synced once per batch,
+// so that a batch is only handed over to the sinks once all its payloads are durable.
+
+class PayloadContext
+{
+public:
+
+    // scratch buffer reused from one payload to the next.
+    std::vector<char>& refBuffer()
+    {
+        return myBuffer;
+    }
+
+    // The payload is written to a temporary file which is synced to disk then renamed.
+    bool writeFile(const std::string& path, const std::vector<char>& buffer);
+
+    bool writePack(PackStore& store, const std::vector<char>& buffer, PackLocation& location);
+
+    bool sync();
+
+private:
+
+    static bool syncDirectory(const std::string& path);
+
+private:
+
+    std::vector<char> myBuffer;
+    std::set<std::string> myDirectories;
+    std::set<PackStore*> myPackStores;
+};
+
+// Pool of threads saving the payloads of batches of samples (see Value::savePayload()).
+
+class PayloadWriter
+{
+public:
+
+    PayloadWriter();
+
+    ~PayloadWriter();
+
+    // Statistics receiving the duration of each save. Null by default.
+    void setRunStats(RunStats* stats);
+
+    // The callback is called from the I/O threads once the payloads of a batch are saved.
+    void start(CompiledGraph* compiled_graph, int num_threads, std::function<void(SampleBatch*)> callback);
+
+    void push(SampleBatch* batch);
+
+    // Waits for the pending batches to be saved and stops the threads.
+    void stop();
+
+    // Saves the payloads of a batch in the calling thread. Returns false on error.
+    static bool save(CompiledGraph* compiled_graph, SampleBatch& batch, PayloadContext& context);
+
+private:
+
+    void run();
+
+private:
+
+    CompiledGraph* myCompiledGraph;
+    RunStats* myRunStats;
+    std::function<void(SampleBatch*)> myCallback;
+    std::vector<std::thread> myThreads;
+    std::mutex myMutex;
+    std::condition_variable myCondition;
+    std::deque<SampleBatch*> myQueue;
+    bool myStopping;
+};
@@ -11,32 +11,122 @@ public:
     PrimitiveValue(ValueFactoryPtr factory) : Value(factory)
     {
         myValue = T();
+        myStorage = &myValue;
     }
 
-    void bind(sqlite3_stmt* stmt, int& offset) override;
+    // value stored in a column.
+    PrimitiveValue(ValueFactoryPtr factory, T* storage) : Value(factory)
+    {
+        myValue = T();
+        myStorage = storage;
+    }
+
+    PrimitiveValue(const PrimitiveValue<T>& other) = delete;
+
+    PrimitiveValue<T>& operator=(const PrimitiveValue<T>& other) = delete;
+
+    void write(FieldWriter& writer, int& offset) override;
+
+    bool read(FieldReader& reader, int& offset) override;
 
     T& ref()
     {
-        return myValue;
+        return *myStorage;
+    }
+
+    const T& ref() const
+    {
+        return *myStorage;
+    }
+
+    size_t getMemorySize() const override
+    {
+        return sizeof(PrimitiveValue<T>) + (myStorage == &myValue ? 0 : sizeof(T));
+    }
+
+    bool isComparable() const override
+    {
+        return ValueContent<T>::supported;
+    }
+
+    uint64_t getHash() const override
+    {
+        return ValueContent<T>::hash(*myStorage);
+    }
+
+    bool isEqual(const Value& other) const override
+    {
+        return ValueContent<T>::equal(*myStorage, static_cast<const PrimitiveValue<T>&>(other).ref());
+    }
+
+    void assign(const Value& other) override
+    {
+        ValueContent<T>::copy(static_cast<const PrimitiveValue<T>&>(other).ref(), *myStorage);
     }
 
 protected:
 
     T myValue;
+    T* myStorage;
 };
 
+// Contiguous array of the values of a batch.
+
+template<typename T>
+class PrimitiveColumn : public ValueColumn
+{
+public:
+
+    PrimitiveColumn(ValueFactoryPtr factory, size_t size) : myData(size)
+    {
+        myValues.resize(size);
+
+        for(size_t i=0; i<size; i++)
+        {
+            myValues[i] = std::make_shared< PrimitiveValue<T> >(factory, &myData[i]);
+        }
+    }
+
+    T* data()
+    {
+        return myData.data();
+    }
+
+protected:
+
+    std::vector<T> myData;
+};
+
+template<>
+inline void PrimitiveValue<int>::write(FieldWriter& writer, int& offset)
+{
+    writer.writeInteger(offset, *myStorage);
+    offset++;
+}
+
+template<>
+inline void PrimitiveValue<double>::write(FieldWriter& writer, int& offset)
+{
+    writer.writeReal(offset, *myStorage);
+    offset++;
+}
+
 template<>
-inline void PrimitiveValue<int>::bind(sqlite3_stmt* stmt, int& offset)
+inline bool PrimitiveValue<int>::read(FieldReader& reader, int& offset)
 {
-    sqlite3_bind_int(stmt, offset, myValue);
+    int64_t value = 0;
+    const bool ok = reader.readInteger(offset, value);
+    *myStorage = int(value);
     offset++;
+    return ok;
 }
 
 template<>
-inline void PrimitiveValue<double>::bind(sqlite3_stmt* stmt, int& offset)
+inline bool PrimitiveValue<double>::read(FieldReader& reader, int& offset)
 {
-    sqlite3_bind_double(stmt, offset, myValue);
+    const bool ok = reader.readReal(offset, *myStorage);
     offset++;
+    return ok;
 }
 
 template<typename T>
@@ -48,34 +138,36 @@ public:
     {
     }
 
-    void getSqlFieldNames(std::vector<std::string>& names) override
-    {
-        names.assign({getName()});
-    }
-
-    void getSqlFieldTypes(std::vector<std::string>& sqltypes) override;
+    void getFields(std::vector<Field>& fields) override;
 
     ValuePtr createValue() override
     {
         return std::make_shared< PrimitiveValue<T> >(shared_from_this());
     }
+
+    ValueColumnPtr createColumn(size_t size) override
+    {
+        return std::make_shared< PrimitiveColumn<T> >(shared_from_this(), size);
+    }
 };
 
 template<>
-inline void PrimitiveValueFactory<int>::getSqlFieldTypes(std::vector<std::string>& sqltypes)
+inline void PrimitiveValueFactory<int>::getFields(std::vector<Field>& fields)
 {
-    sqltypes.assign({"INTEGER"});
+    fields.assign({ Field{getName(), FieldType::Integer} });
 }
 
 template<>
-inline void PrimitiveValueFactory<double>::getSqlFieldTypes(std::vector<std::string>& sqltypes)
+inline void PrimitiveValueFactory<double>::getFields(std::vector<Field>& fields)
 {
-    sqltypes.assign({"FLOAT"});
+    fields.assign({ Field{getName(), FieldType::Real} });
 }
 
 using RealValue = PrimitiveValue<double>;
+using RealColumn = PrimitiveColumn<double>;
 using RealValueFactory = PrimitiveValueFactory<double>;
 
 using IntegerValue = PrimitiveValue<int>;
+using IntegerColumn = PrimitiveColumn<int>;
 using IntegerValueFactory = PrimitiveValueFactory<int>;
 
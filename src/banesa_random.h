@@ -0,0 +1,105 @@
+
+#pragma once
+
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// The output block is a pure function of the key and of the counter.
+
+class Philox4x32
+{
+public:
+
+    static void generate(const uint32_t key[2], const uint32_t counter[4], uint32_t output[4])
+    {
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        uint32_t c0 = counter[0];
+        uint32_t c1 = counter[1];
+        uint32_t c2 = counter[2];
+        uint32_t c3 = counter[3];
+
+        for(int i=0; i<10; i++)
+        {
+            const uint64_t p0 = uint64_t(0xD2511F53) * c0;
+            const uint64_t p1 = uint64_t(0xCD9E8D57) * c2;
+
+            const uint32_t hi0 = uint32_t(p0 >> 32);
+            const uint32_t lo0 = uint32_t(p0);
+            const uint32_t hi1 = uint32_t(p1 >> 32);
+            const uint32_t lo1 = uint32_t(p1);
+
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+
+        output[0] = c0;
+        output[1] = c1;
+        output[2] = c2;
+        output[3] = c3;
+    }
+};
+
+// Stream of random numbers identified by (seed, sample, stream).
+// Satisfies the UniformRandomBitGenerator requirements so that it can be used with the standard distributions.
+
+class RandomStream
+{
+public:
+
+    using result_type = uint32_t;
+
+    RandomStream(uint64_t seed, uint64_t sample, uint32_t stream)
+    {
+        myKey[0] = uint32_t(seed);
+        myKey[1] = uint32_t(seed >> 32);
+        myCounter[0] = 0;
+        myCounter[1] = stream;
+        myCounter[2] = uint32_t(sample);
+        myCounter[3] = uint32_t(sample >> 32);
+        myIndex = 4;
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return 0xFFFFFFFF;
+    }
+
+    result_type operator()()
+    {
+        if(myIndex == 4)
+        {
+            Philox4x32::generate(myKey, myCounter, myBlock);
+            myCounter[0]++;
+            myIndex = 0;
+        }
+
+        return myBlock[myIndex++];
+    }
+
+    // uniform number in [0,1) with 53 bits of precision.
+    double uniform()
+    {
+        const uint64_t a = (*this)() >> 5;
+        const uint64_t b = (*this)() >> 6;
+        return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+    }
+
+protected:
+
+    uint32_t myKey[2];
+    uint32_t myCounter[4];
+    uint32_t myBlock[4];
+    int myIndex;
+};
+
@@ -0,0 +1,255 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <tbb/enumerable_thread_specific.h>
+#include "banesa_run_stats.h"
+
+struct RunStats::ThreadStats
+{
+    std::vector<Timer> nodes;
+    Timer payload;
+    Timer export_wait;
+    Timer export_write;
+    uint64_t stalls;
+    uint64_t stall_time;
+    uint64_t queue_samples;
+    uint64_t queue_total;
+    uint64_t queue_max;
+    std::vector<uint64_t> throughput;
+};
+
+class RunStats::ThreadStatsSet : public tbb::enumerable_thread_specific<RunStats::ThreadStats>
+{
+public:
+
+    ThreadStatsSet(const ThreadStats& exemplar) : tbb::enumerable_thread_specific<ThreadStats>(exemplar)
+    {
+    }
+};
+
+RunStats::RunStats(const std::vector<std::string>& node_names, int num_samples, bool progress)
+{
+    ThreadStats exemplar = ThreadStats();
+
+    exemplar.nodes.resize(node_names.size(), Timer());
+
+    myNodeNames = node_names;
+    myNumSamples = num_samples;
+    myProgress = progress;
+    myStartTime = getTime();
+    myEndTime = myStartTime;
+    myPipelineDepth = 0;
+    myPeakMemory = 0;
+    myExported = 0;
+    myNextProgress = myStartTime;
+    myThreadStats.reset(new ThreadStatsSet(exemplar));
+}
+
+RunStats::~RunStats()
+{
+}
+
+uint64_t RunStats::getTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RunStats::addNodeCall(size_t node, size_t num_samples, uint64_t duration)
+{
+    addTime(refLocal().nodes[node], num_samples, duration);
+}
+
+void RunStats::addPayload(size_t num_samples, uint64_t duration)
+{
+    addTime(refLocal().payload, num_samples, duration);
+}
+
+void RunStats::addExport(size_t num_samples, uint64_t wait_duration, uint64_t write_duration)
+{
+    ThreadStats& local = refLocal();
+    const uint64_t now = getTime();
+    const size_t step = (now - myStartTime) / 1000000000u;
+
+    addTime(local.export_wait, num_samples, wait_duration);
+    addTime(local.export_write, num_samples, write_duration);
+
+    if(local.throughput.size() <= step)
+    {
+        local.throughput.resize(step+1, 0);
+    }
+
+    local.throughput[step] += num_samples;
+
+    myExported += num_samples;
+
+    // the thread which moves the deadline prints the progress line.
+
+    uint64_t next = myNextProgress;
+
+    if(myProgress && now >= next && myNextProgress.compare_exchange_strong(next, now + 1000000000u))
+    {
+        printProgress(now, false);
+    }
+}
+
+void RunStats::addStall(uint64_t duration)
+{
+    ThreadStats& local = refLocal();
+
+    local.stalls++;
+    local.stall_time += duration;
+}
+
+void RunStats::addQueueDepth(size_t depth)
+{
+    ThreadStats& local = refLocal();
+
+    local.queue_samples++;
+    local.queue_total += depth;
+    local.queue_max = std::max<uint64_t>(local.queue_max, depth);
+}
+
+void RunStats::finish(int pipeline_depth, size_t peak_memory)
+{
+    myEndTime = getTime();
+    myPipelineDepth = pipeline_depth;
+    myPeakMemory = peak_memory;
+
+    if(myProgress)
+    {
+        printProgress(myEndTime, true);
+    }
+}
+
+void RunStats::getRecords(std::vector<StatRecord>& records)
+{
+    ThreadStats total = ThreadStats();
+    const double duration = double(myEndTime - myStartTime) * 1.0e-9;
+
+    total.nodes.resize(myNodeNames.size(), Timer());
+
+    for(const ThreadStats& local : *myThreadStats)
+    {
+        for(size_t i=0; i<total.nodes.size(); i++)
+        {
+            merge(total.nodes[i], local.nodes[i]);
+        }
+
+        merge(total.payload, local.payload);
+        merge(total.export_wait, local.export_wait);
+        merge(total.export_write, local.export_write);
+
+        total.stalls += local.stalls;
+        total.stall_time += local.stall_time;
+        total.queue_samples += local.queue_samples;
+        total.queue_total += local.queue_total;
+        total.queue_max = std::max(total.queue_max, local.queue_max);
+
+        if(total.throughput.size() < local.throughput.size())
+        {
+            total.throughput.resize(local.throughput.size(), 0);
+        }
+
+        for(size_t i=0; i<local.throughput.size(); i++)
+        {
+            total.throughput[i] += local.throughput[i];
+        }
+    }
+
+    records.clear();
+
+    records.push_back(StatRecord{"run", "", "samples", -1, double(myExported)});
+    records.push_back(StatRecord{"run", "", "duration_s", -1, duration});
+    records.push_back(StatRecord{"run", "", "samples_per_second", -1, (duration > 0.0) ? myExported / duration : 0.0});
+
+    for(size_t i=0; i<total.throughput.size(); i++)
+    {
+        records.push_back(StatRecord{"run", "", "samples_per_second", int(i), double(total.throughput[i])});
+    }
+
+    for(size_t i=0; i<total.nodes.size(); i++)
+    {
+        getTimerRecords("node", myNodeNames[i], total.nodes[i], records);
+    }
+
+    getTimerRecords("payload", "", total.payload, records);
+    getTimerRecords("export", "wait", total.export_wait, records);
+    getTimerRecords("export", "write", total.export_write, records);
+
+    records.push_back(StatRecord{"pipeline", "", "stalls", -1, double(total.stalls)});
+    records.push_back(StatRecord{"pipeline", "", "stall_ns", -1, double(total.stall_time)});
+    records.push_back(StatRecord{"pipeline", "", "export_queue_mean", -1, (total.queue_samples > 0) ? double(total.queue_total) / total.queue_samples : 0.0});
+    records.push_back(StatRecord{"pipeline", "", "export_queue_max", -1, double(total.queue_max)});
+    records.push_back(StatRecord{"pipeline", "", "depth", -1, double(myPipelineDepth)});
+    records.push_back(StatRecord{"pipeline", "", "peak_memory", -1, double(myPeakMemory)});
+}
+
+RunStats::ThreadStats& RunStats::refLocal()
+{
+    return myThreadStats->local();
+}
+
+void RunStats::addTime(Timer& timer, size_t num_samples, uint64_t duration)
+{
+    // bucket k holds the durations in [2^(k-1), 2^k).
+
+    const int bucket = (duration == 0) ? 0 : std::min(num_buckets-1, 64 - __builtin_clzll(duration));
+
+    timer.calls++;
+    timer.samples += num_samples;
+    timer.total += duration;
+    timer.max = std::max(timer.max, duration);
+    timer.histogram[bucket]++;
+}
+
+void RunStats::merge(Timer& to, const Timer& from)
+{
+    to.calls += from.calls;
+    to.samples += from.samples;
+    to.total += from.total;
+    to.max = std::max(to.max, from.max);
+
+    for(int i=0; i<num_buckets; i++)
+    {
+        to.histogram[i] += from.histogram[i];
+    }
+}
+
+void RunStats::getTimerRecords(const std::string& category, const std::string& name, const Timer& timer, std::vector<StatRecord>& records)
+{
+    records.push_back(StatRecord{category, name, "calls", -1, double(timer.calls)});
+    records.push_back(StatRecord{category, name, "samples", -1, double(timer.samples)});
+    records.push_back(StatRecord{category, name, "total_ns", -1, double(timer.total)});
+    records.push_back(StatRecord{category, name, "mean_ns", -1, (timer.calls > 0) ? double(timer.total) / timer.calls : 0.0});
+    records.push_back(StatRecord{category, name, "max_ns", -1, double(timer.max)});
+
+    for(int i=0; i<num_buckets; i++)
+    {
+        if(timer.histogram[i] > 0)
+        {
+            records.push_back(StatRecord{category, name, "latency_log2_ns", i, double(timer.histogram[i])});
+        }
+    }
+}
+
+void RunStats::printProgress(uint64_t now, bool last)
+{
+    const double elapsed = double(now - myStartTime) * 1.0e-9;
+    const int64_t exported = myExported;
+
+    std::cout << "\r" << exported << "/" << myNumSamples << " samples";
+
+    if(elapsed > 0.0)
+    {
+        std::cout << ", " << int64_t(exported / elapsed) << " samples/s";
+    }
+
+    if(last)
+    {
+        std::cout << std::endl;
+    }
+    else
+    {
+        std::cout << std::flush;
+    }
+}
@@ -0,0 +1,81 @@
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "banesa_sink.h"
+
+// Instrumentation of a run: per-node call counts and latency histograms, time spent saving payloads and samples,
+// pipeline stalls, export queue depth and samples per second over time. Counters are accumulated per thread,
+// hence the methods may be called concurrently without contention. Durations are given in nanoseconds
+// and histograms have one bucket per power of two.
+
+class RunStats
+{
+public:
+
+    RunStats(const std::vector<std::string>& node_names, int num_samples, bool progress);
+
+    ~RunStats();
+
+    // monotonic time in nanoseconds.
+    static uint64_t getTime();
+
+    void addNodeCall(size_t node, size_t num_samples, uint64_t duration);
+
+    void addPayload(size_t num_samples, uint64_t duration);
+
+    // wait_duration is the time spent waiting for a free export lane.
+    void addExport(size_t num_samples, uint64_t wait_duration, uint64_t write_duration);
+
+    // time during which no batch was computed because the pipeline depth was reached.
+    void addStall(uint64_t duration);
+
+    // number of computed batches waiting to be exported.
+    void addQueueDepth(size_t depth);
+
+    void finish(int pipeline_depth, size_t peak_memory);
+
+    void getRecords(std::vector<StatRecord>& records);
+
+private:
+
+    static const int num_buckets = 48;
+
+    struct Timer
+    {
+        uint64_t calls;
+        uint64_t samples;
+        uint64_t total;
+        uint64_t max;
+        uint64_t histogram[num_buckets];
+    };
+
+    struct ThreadStats;
+    class ThreadStatsSet;
+
+private:
+
+    ThreadStats& refLocal();
+
+    static void addTime(Timer& timer, size_t num_samples, uint64_t duration);
+
+    static void merge(Timer& to, const Timer& from);
+
+    static void getTimerRecords(const std::string& category, const std::string& name, const Timer& timer, std::vector<StatRecord>& records);
+
+    void printProgress(uint64_t now, bool last);
+
+private:
+
+    std::vector<std::string> myNodeNames;
+    int myNumSamples;
+    bool myProgress;
+    uint64_t myStartTime;
+    uint64_t myEndTime;
+    int myPipelineDepth;
+    size_t myPeakMemory;
+    std::atomic<int64_t> myExported;
+    std::atomic<uint64_t> myNextProgress;
+    std::unique_ptr<ThreadStatsSet> myThreadStats;
+};
@@ -1,295 +1,1267 @@
 #include <iostream>
-#include <sstream>
-#include <stack>
-#include <set>
-#include <map>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
 #include <tbb/flow_graph.h>
+#include <tbb/task_arena.h>
+#include <tbb/concurrent_queue.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include "banesa.h"
 
 class Sampler::SourceBody
 {
 public:
 
-    SourceBody(int num_samples)
+    // if samples is not null, the samples are those of the list instead of the range.
+    SourceBody(int first_sample, int end_sample, const std::vector<int>& stored_samples, const std::vector<int>* samples, ConvergenceMonitor* monitor) : myStoredSamples(stored_samples)
     {
-        myNumSamples = num_samples;
-        myNextSample = 0;
+        myNumSamples = end_sample;
+        myNextSample = first_sample;
+        myNextStoredSample = 0;
+        mySamples = samples;
+        myNextIndex = 0;
+        myMonitor = monitor;
     }
 
-    bool operator()(int& msg)
+    // fills the batch with the next samples. Returns false if there is no sample left or if the estimators converged.
+    bool operator()(SampleBatch& batch)
+    {
+        int sample = 0;
+        const bool converged = (myMonitor != nullptr && myMonitor->isConverged());
+
+        batch.size = 0;
+        batch.failed = false;
+
+        while(converged == false && batch.size < batch.records.size() && ((mySamples != nullptr) ? getNextListedSample(sample) : getNextSample(sample)))
+        {
+            batch.records[batch.size].sample = sample;
+            batch.size++;
+        }
+
+        return (batch.size > 0);
+    }
+
+protected:
+
+    bool getNextSample(int& sample)
     {
         bool ret = false;
 
+        // skip samples which are already stored.
+
+        while(myNextSample < myNumSamples && myNextStoredSample < myStoredSamples.size())
+        {
+            if(myStoredSamples[myNextStoredSample] < myNextSample)
+            {
+                myNextStoredSample++;
+            }
+            else if(myStoredSamples[myNextStoredSample] == myNextSample)
+            {
+                myNextStoredSample++;
+                myNextSample++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
         if(myNextSample < myNumSamples)
         {
             ret = true;
-            msg = myNextSample;
+            sample = myNextSample;
             myNextSample++;
         }
 
-        return ret;
+        return ret;
+    }
+
+    bool getNextListedSample(int& sample)
+    {
+        bool ret = false;
+
+        // skip samples which are already stored.
+
+        while(ret == false && myNextIndex < mySamples->size())
+        {
+            sample = (*mySamples)[myNextIndex];
+            myNextIndex++;
+
+            ret = (std::binary_search(myStoredSamples.begin(), myStoredSamples.end(), sample) == false);
+        }
+
+        return ret;
+    }
+
+protected:
+
+    int myNumSamples;
+    int myNextSample;
+    const std::vector<int>& myStoredSamples;
+    size_t myNextStoredSample;
+    const std::vector<int>* mySamples;
+    size_t myNextIndex;
+    ConvergenceMonitor* myMonitor;
+};
+
+class Sampler::PipelineController
+{
+public:
+
+    PipelineController(
+        CompiledGraph* compiled_graph,
+        SourceBody* source,
+        size_t batch_size,
+        size_t memory_budget,
+        double target_utilization,
+        std::atomic<int>* depth,
+        std::atomic<size_t>* peak_memory,
+        RunStats* run_stats)
+    {
+        myCompiledGraph = compiled_graph;
+        mySource = source;
+        myBatchSize = batch_size;
+        myMemoryBudget = memory_budget;
+        myTargetUtilization = target_utilization;
+        myConcurrency = std::max(1, tbb::this_task_arena::max_concurrency());
+        myDepthOutput = depth;
+        myPeakMemoryOutput = peak_memory;
+        myRunStats = run_stats;
+        myDepth = 1;
+        myInFlight = 0;
+        myNextSequence = 0;
+        myComputed = 0;
+        myStallStart = 0;
+        myExhausted = false;
+        myMemory = 0;
+        myBatchMemory = 0;
+        myStarted = false;
+        myLastStep = 0;
+        myHold = 0;
+        myLastThroughput = 0.0;
+        myWindowStart = Clock::now();
+        myWindowBusy = 0.0;
+        myWindowSamples = 0;
+        myWindowBatches = 0;
+
+        myDepthOutput->store(myDepth);
+    }
+
+    // batches to put into the pipeline at the beginning of the run.
+    void start(std::vector<SampleBatch*>& issued)
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+        myWindowStart = Clock::now();
+        issue(issued);
+    }
+
+    // called by the sampler once a batch is computed.
+    void notifyComputed(SampleBatch* batch, size_t memory_size, double busy_time)
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+
+        myMemory = myMemory + memory_size - batch->memory_size;
+        batch->memory_size = memory_size;
+        myBatchMemory = std::max(myBatchMemory, memory_size);
+        myWindowBusy += busy_time;
+        myComputed++;
+
+        // the workers stall if every batch in flight is computed and the depth prevents issuing more.
+
+        if(myRunStats != nullptr && myComputed == myInFlight && myInFlight >= myDepth && myExhausted == false)
+        {
+            myStallStart = RunStats::getTime();
+        }
+
+        if(myMemory > myPeakMemoryOutput->load())
+        {
+            myPeakMemoryOutput->store(myMemory);
+        }
+    }
+
+    // called by the exporter once a batch is written. Returns the batches to put into the pipeline.
+    void release(SampleBatch* batch, std::vector<SampleBatch*>& issued)
+    {
+        std::lock_guard<std::mutex> lock(myMutex);
+
+        if(myRunStats != nullptr)
+        {
+            myRunStats->addQueueDepth(myComputed);
+        }
+
+        myComputed--;
+        myInFlight--;
+        myWindowSamples += batch->size;
+        myWindowBatches++;
+        myFreeBatches.push_back(batch);
+
+        adapt();
+
+        // free the batches which are not needed anymore, as they still hold the values of their last samples.
+
+        while(myBatches.size() > size_t(myDepth) && myFreeBatches.empty() == false)
+        {
+            SampleBatch* unused = myFreeBatches.back();
+            myFreeBatches.pop_back();
+            myMemory -= unused->memory_size;
+
+            auto it = std::find_if(myBatches.begin(), myBatches.end(), [unused] (const std::unique_ptr<SampleBatch>& b) { return b.get() == unused; });
+            myBatches.erase(it);
+        }
+
+        issue(issued);
+    }
+
+protected:
+
+    using Clock = std::chrono::steady_clock;
+
+    // maximum number of batches in flight, whatever the memory budget.
+    static const int maximum_depth = 256;
+
+    // minimum duration of the windows over which the utilization is measured, in seconds.
+    static constexpr double window_duration = 0.01;
+
+protected:
+
+    void issue(std::vector<SampleBatch*>& issued)
+    {
+        while(myExhausted == false && myInFlight < myDepth)
+        {
+            SampleBatch* batch = nullptr;
+
+            if(myFreeBatches.empty())
+            {
+                myBatches.emplace_back(new SampleBatch());
+                batch = myBatches.back().get();
+                myCompiledGraph->createBatch(*batch, myBatchSize);
+            }
+            else
+            {
+                batch = myFreeBatches.back();
+                myFreeBatches.pop_back();
+            }
+
+            if((*mySource)(*batch))
+            {
+                // batches are numbered in the order of their samples, for the sequencer of ordered export.
+
+                batch->sequence = myNextSequence++;
+                issued.push_back(batch);
+                myInFlight++;
+
+                if(myStallStart != 0)
+                {
+                    myRunStats->addStall(RunStats::getTime() - myStallStart);
+                    myStallStart = 0;
+                }
+            }
+            else
+            {
+                myFreeBatches.push_back(batch);
+                myExhausted = true;
+            }
+        }
+    }
+
+    void adapt()
+    {
+        const Clock::time_point now = Clock::now();
+        const double elapsed = std::chrono::duration<double>(now - myWindowStart).count();
+        const int limit = getMemoryLimit();
+
+        if(myStarted == false)
+        {
+            // the first batch tells how much memory a batch takes.
+
+            myStarted = true;
+            setDepth(std::min(myConcurrency, limit));
+            resetWindow(now, 0.0);
+        }
+        else if(myDepth > limit)
+        {
+            setDepth(limit);
+            myLastStep = 0;
+            resetWindow(now, 0.0);
+        }
+        else if(elapsed >= window_duration && myWindowBatches >= myDepth)
+        {
+            const double utilization = myWindowBusy / (elapsed * myConcurrency);
+            const double throughput = myWindowSamples / elapsed;
+            const int last_step = myLastStep;
+
+            myLastStep = 0;
+
+            if(last_step > 0 && throughput < 1.05 * myLastThroughput)
+            {
+                // the last increase did not pay off, hence the bottleneck is elsewhere (export, I/O).
+
+                setDepth(std::max(1, myDepth - last_step));
+                myHold = 16;
+            }
+            else if(myHold > 0)
+            {
+                myHold--;
+            }
+            else if(utilization < myTargetUtilization && myDepth < limit)
+            {
+                const int step = std::min(std::max(1, myDepth/4), limit - myDepth);
+                setDepth(myDepth + step);
+                myLastStep = step;
+            }
+
+            resetWindow(now, throughput);
+        }
+    }
+
+    void resetWindow(Clock::time_point now, double throughput)
+    {
+        myLastThroughput = throughput;
+        myWindowStart = now;
+        myWindowBusy = 0.0;
+        myWindowSamples = 0;
+        myWindowBatches = 0;
+    }
+
+    void setDepth(int depth)
+    {
+        myDepth = depth;
+        myDepthOutput->store(depth);
+    }
+
+    int getMemoryLimit()
+    {
+        int ret = maximum_depth;
+
+        if(myMemoryBudget > 0 && myBatchMemory > 0)
+        {
+            ret = int( std::min<size_t>(maximum_depth, std::max<size_t>(1, myMemoryBudget / myBatchMemory)) );
+        }
+
+        return ret;
+    }
+
+protected:
+
+    CompiledGraph* myCompiledGraph;
+    SourceBody* mySource;
+    size_t myBatchSize;
+    size_t myMemoryBudget;
+    double myTargetUtilization;
+    int myConcurrency;
+    std::atomic<int>* myDepthOutput;
+    std::atomic<size_t>* myPeakMemoryOutput;
+    RunStats* myRunStats;
+
+    std::mutex myMutex;
+    std::vector< std::unique_ptr<SampleBatch> > myBatches;
+    std::vector<SampleBatch*> myFreeBatches;
+    int myDepth;
+    int myInFlight;
+    size_t myNextSequence;
+    int myComputed;
+    uint64_t myStallStart;
+    bool myExhausted;
+    size_t myMemory;
+    size_t myBatchMemory;
+
+    bool myStarted;
+    int myLastStep;
+    int myHold;
+    double myLastThroughput;
+    Clock::time_point myWindowStart;
+    double myWindowBusy;
+    size_t myWindowSamples;
+    int myWindowBatches;
+};
+
+class Sampler::SamplerBody
+{
+public:
+
+    SamplerBody(CompiledGraph* compiled_graph, uint64_t seed, bool node_parallelism, PipelineController* controller)
+    {
+        myCompiledGraph = compiled_graph;
+        mySeed = seed;
+        myNodeParallelism = node_parallelism;
+        myController = controller;
+    }
+
+    SampleBatch* operator()(SampleBatch* batch)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if(myNodeParallelism)
+        {
+            myCompiledGraph->executeParallel(mySeed, *batch);
+        }
+        else
+        {
+            myCompiledGraph->execute(mySeed, *batch);
+        }
+
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        myController->notifyComputed(batch, CompiledGraph::getMemorySize(*batch), std::chrono::duration<double>(end - start).count());
+
+        return batch;
+    }
+
+protected:
+
+    CompiledGraph* myCompiledGraph;
+    uint64_t mySeed;
+    bool myNodeParallelism;
+    PipelineController* myController;
+};
+
+class Sampler::PayloadBody
+{
+public:
+
+    using PayloadNode = tbb::flow::async_node<SampleBatch*, SampleBatch*>;
+
+    PayloadBody(PayloadWriter* writer)
+    {
+        myWriter = writer;
+    }
+
+    void operator()(SampleBatch* batch, PayloadNode::gateway_type& gateway)
+    {
+        // the graph is kept alive until the I/O thread puts the batch back.
+
+        gateway.reserve_wait();
+        myWriter->push(batch);
+    }
+
+protected:
+
+    PayloadWriter* myWriter;
+};
+
+class Sampler::ExportBody
+{
+public:
+
+    ExportBody(
+        const std::vector<SinkPtr>& sinks,
+        tbb::concurrent_bounded_queue<size_t>* free_lanes,
+        PipelineController* controller,
+        tbb::flow::receiver<SampleBatch*>* sampler_node,
+        RunStats* run_stats,
+        ConvergenceMonitor* monitor,
+        std::atomic<bool>* failed,
+        bool ordered) :
+
+        mySinks(sinks)
+    {
+        myMonitor = monitor;
+        myOrdered = ordered;
+        myFreeLanes = free_lanes;
+        myController = controller;
+        mySamplerNode = sampler_node;
+        myRunStats = run_stats;
+        myFailed = failed;
+        myIssued.resize(sinks.size());
+    }
+
+    tbb::flow::continue_msg operator()(SampleBatch* batch)
+    {
+        size_t lane = 0;
+        bool ok = (batch->failed == false);
+        const uint64_t start = (myRunStats != nullptr) ? RunStats::getTime() : 0;
+
+        // in ordered mode, the batches come one at a time and the samples are dispatched as in sequential mode.
+
+        if(myOrdered == false)
+        {
+            myFreeLanes->pop(lane);
+        }
+
+        const uint64_t acquired = (myRunStats != nullptr) ? RunStats::getTime() : 0;
+
+        for(size_t i=0; ok && i<batch->size; i++)
+        {
+            const SampleRecord& record = batch->records[i];
+            lane = (myOrdered) ? record.sample % mySinks.size() : lane;
+            ok = mySinks[lane]->write(record.sample, record.values);
+
+            if(ok && myMonitor != nullptr)
+            {
+                myMonitor->add(record.values);
+            }
+        }
+
+        if(myRunStats != nullptr)
+        {
+            myRunStats->addExport(batch->size, acquired - start, RunStats::getTime() - acquired);
+        }
+
+        if(ok == false)
+        {
+            *myFailed = true;
+        }
+
+        // recycle the batch and let the controller decide how many batches to put into the pipeline.
+        // The list of issued batches belongs to the lane, which is held until then, so that it is reused without allocation.
+        // In ordered mode, a single batch is exported at a time.
+
+        std::vector<SampleBatch*>& issued = myIssued[(myOrdered) ? 0 : lane];
+
+        issued.clear();
+        myController->release(batch, issued);
+
+        for(SampleBatch* next : issued)
+        {
+            mySamplerNode->try_put(next);
+        }
+
+        if(myOrdered == false)
+        {
+            myFreeLanes->push(lane);
+        }
+
+        return tbb::flow::continue_msg();
+    }
+
+protected:
+
+    const std::vector<SinkPtr>& mySinks;
+    bool myOrdered;
+    tbb::concurrent_bounded_queue<size_t>* myFreeLanes;
+    PipelineController* myController;
+    tbb::flow::receiver<SampleBatch*>* mySamplerNode;
+    RunStats* myRunStats;
+    ConvergenceMonitor* myMonitor;
+    std::atomic<bool>* myFailed;
+    std::vector< std::vector<SampleBatch*> > myIssued;
+};
+
+// Sink of a worker process, which reports the number of samples of its range stored so far to the coordinator.
+
+class Sampler::ProgressSink : public Sink
+{
+public:
+
+    ProgressSink(SinkPtr sink, int first_sample, int end_sample, int fd)
+    {
+        mySink = std::move(sink);
+        myFirstSample = first_sample;
+        myEndSample = end_sample;
+        myFd = fd;
+        myDone = 0;
+    }
+
+    bool open(const std::vector<Field>& fields) override
+    {
+        return mySink->open(fields);
+    }
+
+    bool write(int sample, const std::vector<ValuePtr>& values) override
+    {
+        const bool ok = mySink->write(sample, values);
+
+        myDone++;
+
+        if(myDone % report_period == 0)
+        {
+            report();
+        }
+
+        return ok;
+    }
+
+    bool getStoredSamples(std::vector<int>& samples) override
+    {
+        const bool ok = mySink->getStoredSamples(samples);
+
+        myDone = std::lower_bound(samples.begin(), samples.end(), myEndSample) - std::lower_bound(samples.begin(), samples.end(), myFirstSample);
+        report();
+
+        return ok;
+    }
+
+    bool writeStats(const std::vector<StatRecord>& records) override
+    {
+        return mySink->writeStats(records);
+    }
+
+    bool close() override
+    {
+        const bool ok = mySink->close();
+
+        report();
+
+        return ok;
+    }
+
+protected:
+
+    static const int64_t report_period = 64;
+
+protected:
+
+    void report()
+    {
+        // messages are smaller than PIPE_BUF, hence written atomically. Errors are ignored as the coordinator may be gone.
+
+        const ssize_t written = ::write(myFd, &myDone, sizeof(myDone));
+        (void) written;
+    }
+
+protected:
+
+    SinkPtr mySink;
+    int myFirstSample;
+    int myEndSample;
+    int myFd;
+    int64_t myDone;
+};
+
+Sampler::Sampler()
+{
+    myBulkLoad = false;
+    myRowsPerTransaction = 10000;
+    myRowsPerStatement = 100;
+    myNumShards = 1;
+    myMergeShards = true;
+    myAppend = false;
+    mySeed = 0;
+    myNodeParallelism = false;
+    myBatchSize = 1;
+    myIOThreads = 2;
+    myMemoryBudget = size_t(1) << 30;
+    myTargetUtilization = 0.9;
+    myRunStats = false;
+    myProgress = false;
+    myOrderedExport = false;
+    myDesign = DesignType::Random;
+    myPipelineDepth = 0;
+    myPeakMemory = 0;
+}
+
+void Sampler::setBulkLoad(bool bulk_load, int rows_per_transaction, int rows_per_statement)
+{
+    myBulkLoad = bulk_load;
+    myRowsPerTransaction = rows_per_transaction;
+    myRowsPerStatement = rows_per_statement;
+}
+
+void Sampler::setShards(int num_shards, bool merge)
+{
+    myNumShards = num_shards;
+    myMergeShards = merge;
+}
+
+void Sampler::setAppend(bool append)
+{
+    myAppend = append;
+}
+
+void Sampler::setNodeParallelism(bool node_parallelism)
+{
+    myNodeParallelism = node_parallelism;
+}
+
+void Sampler::setSeed(uint64_t seed)
+{
+    mySeed = seed;
+}
+
+void Sampler::setIOThreads(int num_threads)
+{
+    myIOThreads = num_threads;
+}
+
+void Sampler::setBatchSize(int batch_size)
+{
+    myBatchSize = batch_size;
+}
+
+void Sampler::setMemoCache(MemoCachePtr cache)
+{
+    myMemoCache = std::move(cache);
+}
+
+void Sampler::setRunStats(bool run_stats)
+{
+    myRunStats = run_stats;
+}
+
+void Sampler::setProgress(bool progress)
+{
+    myProgress = progress;
+}
+
+void Sampler::setOrderedExport(bool ordered)
+{
+    myOrderedExport = ordered;
+}
+
+void Sampler::setDesign(DesignType type)
+{
+    myDesign = type;
+}
+
+void Sampler::setConvergence(ConvergenceMonitorPtr monitor)
+{
+    myConvergence = std::move(monitor);
+}
+
+const std::vector<StatRecord>& Sampler::refRunStats()
+{
+    return myStatRecords;
+}
+
+void Sampler::setMemoryBudget(size_t bytes)
+{
+    myMemoryBudget = bytes;
+}
+
+void Sampler::setTargetUtilization(double utilization)
+{
+    myTargetUtilization = utilization;
+}
+
+int Sampler::getPipelineDepth()
+{
+    return myPipelineDepth;
+}
+
+size_t Sampler::getPeakMemory()
+{
+    return myPeakMemory;
+}
+
+bool Sampler::run( const std::vector<NodePtr>& graph, int num_samples, const std::string& db_path, bool multithread)
+{
+    bool ok = true;
+    std::vector<SinkPtr> sinks;
+    std::vector<std::string> shard_paths;
+
+    if(myNumShards > 1)
+    {
+        for(int i=0; i<myNumShards; i++)
+        {
+            shard_paths.push_back(db_path + "." + std::to_string(i));
+        }
+    }
+    else
+    {
+        shard_paths.push_back(db_path);
+    }
+
+    for(const std::string& path : shard_paths)
+    {
+        std::shared_ptr<SQLiteSink> sink = std::make_shared<SQLiteSink>(path);
+        sink->setBulkLoad(myBulkLoad, myRowsPerTransaction, myRowsPerStatement);
+        sink->setAppend(myAppend);
+        sinks.push_back(sink);
+    }
+
+    // the shards are removed once merged, hence the samples of a previous run are those of the merged database.
+
+    if(myAppend && myNumShards > 1 && myMergeShards)
+    {
+        ok = getMergedSamples(db_path, myMergedSamples);
+    }
+
+    if(ok)
+    {
+        ok = run(graph, num_samples, sinks, multithread);
+    }
+    else
+    {
+        std::cout << "Could not retrieve merged samples!" << std::endl;
+    }
+
+    myMergedSamples.clear();
+
+    if(ok && myNumShards > 1 && myMergeShards)
+    {
+        ok = SQLiteSink::merge(db_path, shard_paths, myAppend);
+
+        if(ok)
+        {
+            for(const std::string& path : shard_paths)
+            {
+                std::remove(path.c_str());
+            }
+        }
+        else
+        {
+            std::cout << "Could not merge database shards!" << std::endl;
+        }
+    }
+
+    return ok;
+}
+
+bool Sampler::runProcesses(const GraphFactory& factory, int num_samples, const std::string& db_path, int num_processes)
+{
+    bool ok = true;
+    const char* err = "";
+    std::vector<Worker> workers;
+    std::vector<std::string> shard_paths;
+    std::unique_ptr<RunStats> progress;
+    int running = 0;
+
+    if(ok)
+    {
+        ok = (num_processes > 0 && num_samples >= 0);
+        err = "Incorrect number of processes!";
     }
 
-protected:
+    // one range of sample ids and one shard per worker.
 
-    int myNumSamples;
-    int myNextSample;
-};
+    if(ok)
+    {
+        num_processes = std::max(1, std::min(num_processes, num_samples));
 
-class Sampler::SamplerBody
-{
-public:
+        for(int i=0; i<num_processes; i++)
+        {
+            Worker worker;
+            worker.first_sample = int( int64_t(num_samples) * i / num_processes );
+            worker.end_sample = int( int64_t(num_samples) * (i+1) / num_processes );
+            worker.num_samples = num_samples;
+            worker.path = db_path + "." + std::to_string(i);
+            worker.attempts = 0;
+            worker.pid = -1;
+            worker.fd = -1;
+            worker.done = 0;
+
+            if(myAppend == false)
+            {
+                std::remove(worker.path.c_str());
+            }
+
+            workers.push_back(worker);
+            shard_paths.push_back(worker.path);
+        }
+
+        if(myProgress)
+        {
+            progress.reset(new RunStats(std::vector<std::string>(), num_samples, true));
+        }
+    }
 
-    SamplerBody(
-        const std::vector<NodePtr>& ordered_nodes,
-        const std::map<std::string,NodePtr>& node_map,
-        const std::map<std::string,size_t>& offset,
-        const std::vector<ValueFactoryPtr>& value_factories) :
+    // the workers inherit the samples already merged, as in run().
 
-        myOrderedNodes(ordered_nodes),
-        myNodeMap(node_map),
-        myOffset(offset),
-        myValueFactories(value_factories)
+    if(ok && myAppend && myMergeShards)
     {
+        ok = getMergedSamples(db_path, myMergedSamples);
+        err = "Could not retrieve merged samples!";
     }
 
-    ValueTablePtr operator()(int sample)
+    for(size_t i=0; ok && i<workers.size(); i++)
     {
-        std::vector<ValuePtr> input_values;
-        std::vector<ValuePtr> output_values;
+        ok = startWorker(factory, workers[i]);
+        err = "Could not start worker process!";
+        running += (ok) ? 1 : 0;
+    }
 
-        ValueTablePtr ret = std::make_shared<ValueTable>();
+    // collect the progress reports. The pipe of a worker is closed when it exits, whatever the reason.
 
-        ret->sample = sample;
+    while(ok && running > 0)
+    {
+        std::vector<pollfd> fds;
+        std::vector<size_t> indices;
 
-        for(ValueFactoryPtr factory : myValueFactories)
+        for(size_t i=0; i<workers.size(); i++)
         {
-            ret->values.push_back(factory->createValue());
+            if(workers[i].fd >= 0)
+            {
+                fds.push_back(pollfd{workers[i].fd, POLLIN, 0});
+                indices.push_back(i);
+            }
         }
 
-        for(NodePtr node : myOrderedNodes)
+        const int num_events = poll(fds.data(), fds.size(), 1000);
+
+        for(size_t j=0; ok && num_events > 0 && j<fds.size(); j++)
         {
-            // gather input values.
+            Worker& worker = workers[indices[j]];
+            int64_t message = 0;
+            ssize_t num_read = 0;
 
-            input_values.clear();
+            if(fds[j].revents != 0)
+            {
+                num_read = ::read(worker.fd, &message, sizeof(message));
+            }
 
-            for(std::string other_node_name : node->refDependencies())
+            if(num_read == sizeof(message))
             {
-                NodePtr other_node = myNodeMap.find(other_node_name)->second;
+                // a replacement worker reports again the samples of its predecessor.
+
+                if(message > worker.done)
+                {
+                    if(progress)
+                    {
+                        progress->addExport(size_t(message - worker.done), 0, 0);
+                    }
 
-                std::copy(
-                    ret->values.begin() + myOffset.find(other_node_name)->second,
-                    ret->values.begin() + myOffset.find(other_node_name)->second + other_node->refValueFactories().size(),
-                    std::back_inserter(input_values));
+                    worker.done = message;
+                }
             }
+            else if(fds[j].revents != 0 && (num_read == 0 || errno != EINTR))
+            {
+                int status = 0;
+
+                close(worker.fd);
+                worker.fd = -1;
+                running--;
 
-            // gather output values.
+                while(waitpid(worker.pid, &status, 0) < 0 && errno == EINTR);
 
-            output_values.clear();
+                // a crashed worker is replaced by a new one, which resumes its shard.
 
-            std::copy(
-                ret->values.begin() + myOffset.find(node->getName())->second,
-                ret->values.begin() + myOffset.find(node->getName())->second + node->refValueFactories().size(),
-                std::back_inserter(output_values));
+                if(WIFEXITED(status) == false || WEXITSTATUS(status) != 0)
+                {
+                    std::cout << "Worker process " << worker.pid << " failed on samples " << worker.first_sample << " to " << worker.end_sample << "!" << std::endl;
 
-            // call sampling function.
+                    ok = (worker.attempts < max_worker_attempts);
+                    err = "Worker process failed too many times!";
 
-            node->getSample(input_values, output_values);
+                    if(ok)
+                    {
+                        ok = startWorker(factory, worker);
+                        err = "Could not start worker process!";
+                        running += (ok) ? 1 : 0;
+                    }
+                }
+            }
         }
-
-        return ret;
     }
 
-protected:
+    // on failure, the remaining workers are stopped.
 
-    const std::vector<NodePtr>& myOrderedNodes;
-    const std::map<std::string,NodePtr>& myNodeMap;
-    const std::map<std::string,size_t>& myOffset;
-    const std::vector<ValueFactoryPtr>& myValueFactories;
-};
+    for(Worker& worker : workers)
+    {
+        if(worker.fd >= 0)
+        {
+            int status = 0;
 
-class Sampler::ExportBody
-{
-public:
+            kill(worker.pid, SIGKILL);
+            close(worker.fd);
+            worker.fd = -1;
+
+            while(waitpid(worker.pid, &status, 0) < 0 && errno == EINTR);
+        }
+    }
 
-    ExportBody(sqlite3_stmt* insert_stmt)
+    if(progress)
     {
-        myInsertStatement = insert_stmt;
+        progress->finish(0, 0);
     }
 
-    tbb::flow::continue_msg operator()(const ValueTablePtr& value_table)
+    myMergedSamples.clear();
+
+    if(ok && myMergeShards)
     {
-        const bool ok = saveSample(myInsertStatement, value_table->values);
+        ok = SQLiteSink::merge(db_path, shard_paths, myAppend);
+        err = "Could not merge database shards!";
 
-        if(ok == false)
+        if(ok)
         {
-            std::cout << "Could not insert sample to database!" << std::endl;
+            for(const std::string& path : shard_paths)
+            {
+                std::remove(path.c_str());
+            }
         }
-
-        return tbb::flow::continue_msg();
     }
 
-protected:
+    if(ok == false)
+    {
+        std::cout << err << std::endl;
+    }
 
-    sqlite3_stmt* myInsertStatement;
-};
+    return ok;
+}
 
-bool Sampler::initializeDatabase(const std::vector<NodePtr>& graph, sqlite3*& db, const std::string& db_path)
+bool Sampler::startWorker(const GraphFactory& factory, Worker& worker)
 {
-    std::vector<std::string> field_names;
-    std::vector<std::string> field_types;
-    std::vector<std::string> local_field_names;
-    std::vector<std::string> local_field_types;
+    int fds[2] = {-1, -1};
+    bool ok = (pipe(fds) == 0);
 
-    field_names.assign({"id"});
-    field_types.assign({"INTEGER PRIMARY KEY"});
+    // buffered output would be printed by both processes.
 
-    for(NodePtr n : graph)
+    if(ok)
     {
-        for( const ValueFactoryPtr vf : n->refValueFactories() )
-        {
-            vf->getSqlFieldNames(local_field_names);
-            vf->getSqlFieldTypes(local_field_types);
-
-            field_names.insert( field_names.end(), local_field_names.begin(), local_field_names.end() );
-            field_types.insert( field_types.end(), local_field_types.begin(), local_field_types.end() );
-        }
+        std::cout.flush();
+        worker.attempts++;
+        worker.pid = fork();
+        ok = (worker.pid >= 0);
     }
 
-    std::stringstream query;
-    query << "DROP TABLE IF EXISTS samples;";
-    query << "CREATE TABLE samples(";
-    for(size_t i=0; i<field_names.size(); i++)
+    // the worker exits without unwinding the state inherited from the coordinator.
+
+    if(ok && worker.pid == 0)
     {
-        if( i > 0 )
-        {
-            query << ", ";
-        }
+        close(fds[0]);
+        signal(SIGPIPE, SIG_IGN);
 
-        query << field_names[i] << " " << field_types[i];
-    }
-    query << ");";
+        const bool worker_ok = runWorker(factory, worker, fds[1]);
 
-    bool ok = true;
+        std::cout.flush();
+        _exit(worker_ok ? 0 : 1);
+    }
 
     if(ok)
     {
-        ok = (SQLITE_OK == sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, nullptr));
+        close(fds[1]);
+        worker.fd = fds[0];
     }
-
-    if(ok)
+    else if(fds[0] >= 0)
     {
-        ok = (SQLITE_OK == sqlite3_exec(db, query.str().c_str(), nullptr, nullptr, nullptr));
+        close(fds[0]);
+        close(fds[1]);
     }
 
     return ok;
 }
 
-bool Sampler::createInsertionStatement(sqlite3* db, std::vector<ValueFactoryPtr>& value_factories, sqlite3_stmt** stmt)
+bool Sampler::runWorker(const GraphFactory& factory, const Worker& worker, int fd)
 {
-    std::stringstream sql;
-    size_t field_count = 0;
-    std::vector<std::string> local_field_names;
+    std::shared_ptr<SQLiteSink> sink = std::make_shared<SQLiteSink>(worker.path);
 
-    sql << "INSERT INTO samples(";
+    // the shard is always appended to, so that a replacement worker resumes it.
 
-    for(size_t i=0; i<value_factories.size(); i++)
-    {
-        value_factories[i]->getSqlFieldNames(local_field_names);
+    sink->setBulkLoad(myBulkLoad, myRowsPerTransaction, myRowsPerStatement);
+    sink->setAppend(true);
 
-        for(std::string& field_name : local_field_names)
-        {
-            if(field_count > 0)
-            {
-                sql << ", ";
-            }
+    myProgress = false;
+    myConvergence.reset();
 
-            sql << field_name;
+    const std::vector<SinkPtr> sinks{ std::make_shared<ProgressSink>(sink, worker.first_sample, worker.end_sample, fd) };
 
-            field_count++;
-        }
+    return runRange(factory(), worker.first_sample, worker.end_sample, worker.num_samples, sinks, false, nullptr, std::vector<std::string>());
+}
+
+bool Sampler::getMergedSamples(const std::string& db_path, std::vector<int>& samples)
+{
+    bool ok = true;
+
+    samples.clear();
+
+    if(access(db_path.c_str(), F_OK) == 0)
+    {
+        SQLiteSource source(db_path);
+
+        ok = source.open(std::vector<Field>()) && source.getSamples(samples);
+
+        source.close();
     }
 
-    sql << ") VALUES (";
+    return ok;
+}
+
+bool Sampler::run( const std::vector<NodePtr>& graph, int num_samples, SinkPtr sink, bool multithread)
+{
+    return run(graph, num_samples, std::vector<SinkPtr>{ sink }, multithread);
+}
+
+bool Sampler::run( const std::vector<NodePtr>& graph, int num_samples, const std::vector<SinkPtr>& sinks, bool multithread)
+{
+    return runRange(graph, 0, num_samples, num_samples, sinks, multithread, nullptr, std::vector<std::string>());
+}
+
+bool Sampler::runIncremental(const std::vector<NodePtr>& graph, const std::vector<std::string>& changed_nodes, const std::string& db_path, const std::string& table, bool multithread)
+{
+    bool ok = true;
+    SampleSourcePtr source = std::make_shared<SQLiteSource>(db_path);
+    std::shared_ptr<SQLiteSink> sink = std::make_shared<SQLiteSink>(db_path);
+
+    sink->setBulkLoad(myBulkLoad, myRowsPerTransaction, myRowsPerStatement);
+    sink->setAppend(myAppend);
+    sink->setTable(table);
+
+    // the source table must not be overwritten while it is read.
 
-    for(size_t i=0; i<field_count; i++)
+    ok = (table != "samples");
+
+    if(ok)
     {
-        if( i > 0 )
-        {
-            sql << ", ";
-        }
-        sql << "?";
+        ok = runIncremental(graph, changed_nodes, source, std::vector<SinkPtr>{ sink }, multithread);
+    }
+    else
+    {
+        std::cout << "Incorrect table!" << std::endl;
     }
-    sql << ")";
 
-    return (SQLITE_OK == sqlite3_prepare_v2(db, sql.str().c_str(), -1, stmt, nullptr));
+    return ok;
+}
+
+bool Sampler::runIncremental(const std::vector<NodePtr>& graph, const std::vector<std::string>& changed_nodes, SampleSourcePtr source, const std::vector<SinkPtr>& sinks, bool multithread)
+{
+    return runRange(graph, 0, 0, 0, sinks, multithread, source.get(), changed_nodes);
 }
 
-void Sampler::run( const std::vector<NodePtr>& graph, int num_samples, const std::string& db_path, bool multithread)
+bool Sampler::runRange( const std::vector<NodePtr>& graph, int first_sample, int end_sample, int num_samples, const std::vector<SinkPtr>& sinks, bool multithread, SampleSource* source, const std::vector<std::string>& changed_nodes)
 {
     bool ok = true;
     const char* err = "";
-    sqlite3* db = nullptr;
-    sqlite3_stmt* insert_stmt = nullptr;
 
-    std::vector<ValuePtr> values;
-    std::vector<ValueFactoryPtr> value_factories;
-    std::map<std::string, size_t> offset;
-    std::map<std::string, NodePtr> node_map;
+    CompiledGraph compiled_graph;
+    std::vector<int> stored_samples;
+    std::vector<int> source_samples;
+    const std::vector<int>* listed_samples = nullptr;
+    size_t batch_capacity = 0;
+    size_t num_open_sinks = 0;
+    bool source_open = false;
+    std::unique_ptr<RunStats> run_stats;
 
-    std::vector<NodePtr> ordered_nodes;
+    myPipelineDepth = 0;
+    myPeakMemory = 0;
+    myStatRecords.clear();
 
-    std::vector<ValuePtr> input_values;
-    std::vector<ValuePtr> output_values;
+    // compute the execution plan.
 
     if(ok)
     {
-        ok = initializeDatabase(graph, db, db_path);
-        err = "Could not initialize database!";
+        compiled_graph.setMemoCache(myMemoCache);
+        ok = compiled_graph.build(graph);
+        err = "Incorrect graph!";
     }
 
-    // allocate values.
+    if(ok && myProgress && compiled_graph.getNumDeadNodes() > 0)
+    {
+        std::cout << compiled_graph.getNumDeadNodes() << " nodes are not computed as their outputs are not used." << std::endl;
+    }
 
     if(ok)
     {
-        values.clear();
-        offset.clear();
-        node_map.clear();
+        ok = (myBatchSize > 0);
+        err = "Incorrect batch size!";
+    }
 
-        for(NodePtr n : graph)
-        {
-            offset[n->getName()] = value_factories.size();
-            node_map[n->getName()] = n;
+    // design points are planned over all the samples of the run, whatever the range computed here.
 
-            for( ValueFactoryPtr vf : n->refValueFactories() )
-            {
-                value_factories.push_back(vf);
-            }
+    if(ok)
+    {
+        ok = compiled_graph.setDesign(myDesign, num_samples, mySeed);
+        err = "Too many design dimensions!";
+    }
 
-            if( multithread == false )
-            {
-                for( ValueFactoryPtr vf : n->refValueFactories() )
-                {
-                    values.push_back(vf->createValue());
-                }
-            }
-        }
+    // with fan-out, a batch holds batch size upstream samples.
+
+    if(ok)
+    {
+        batch_capacity = size_t(myBatchSize) * compiled_graph.getMultiplicity();
+    }
+
+    if(ok)
+    {
+        ok = (myIOThreads > 0 || compiled_graph.refPayloadValues().empty());
+        err = "Incorrect number of I/O threads!";
     }
 
-    // create statement to save a record to database.
+    // open the sinks.
 
     if(ok)
     {
-        ok = createInsertionStatement(db, value_factories, &insert_stmt);
-        err = "Could not create insertion statement!";
+        ok = (sinks.empty() == false);
+        err = "No sink!";
+    }
+
+    for(size_t i=0; ok && i<sinks.size(); i++)
+    {
+        ok = sinks[i]->open(compiled_graph.refFields());
+        err = "Could not open sink!";
+
+        if(ok)
+        {
+            num_open_sinks++;
+        }
+    }
+
+    // retrieve the samples stored by a previous run.
+
+    for(size_t i=0; ok && i<sinks.size(); i++)
+    {
+        std::vector<int> local_stored_samples;
+
+        ok = sinks[i]->getStoredSamples(local_stored_samples);
+        err = "Could not retrieve stored samples!";
+
+        stored_samples.insert(stored_samples.end(), local_stored_samples.begin(), local_stored_samples.end());
     }
 
-    // Compute in which order to process the nodes.
+    stored_samples.insert(stored_samples.end(), myMergedSamples.begin(), myMergedSamples.end());
 
     if(ok)
     {
-        ok = reorderNodes(graph, ordered_nodes);
-        err = "Incorrect graph!";
+        std::sort(stored_samples.begin(), stored_samples.end());
+        stored_samples.erase(std::unique(stored_samples.begin(), stored_samples.end()), stored_samples.end());
+    }
+
+    // with a source, the samples are those of the source.
+
+    if(ok && source != nullptr)
+    {
+        ok = source->open(compiled_graph.refFields());
+        err = "Could not open source!";
+        source_open = ok;
+    }
+
+    if(ok && source != nullptr)
+    {
+        ok = source->getSamples(source_samples);
+        err = "Could not retrieve source samples!";
+        listed_samples = &source_samples;
+    }
+
+    if(ok && source_samples.empty() == false)
+    {
+        ok = compiled_graph.setSource(source, changed_nodes, source_samples.front());
+        err = "Incorrect changed nodes!";
+    }
+
+    // the design of the original run is assumed to be planned over all the samples up to the last one stored.
+
+    if(ok && source_samples.empty() == false)
+    {
+        ok = compiled_graph.setDesign(myDesign, source_samples.back() + 1, mySeed);
+        err = "Too many design dimensions!";
+    }
+
+    if(ok && myConvergence)
+    {
+        ok = myConvergence->open(compiled_graph.refFields());
+        err = "Incorrect convergence criteria!";
+    }
+
+    // instrumentation. Node calls are only timed if the statistics are saved.
+
+    if(ok && (myRunStats || myProgress))
+    {
+        std::vector<std::string> node_names;
+        int num_pending = std::max(0, end_sample - first_sample) - int(std::lower_bound(stored_samples.begin(), stored_samples.end(), end_sample) - std::lower_bound(stored_samples.begin(), stored_samples.end(), first_sample));
+
+        if(listed_samples != nullptr)
+        {
+            num_pending = std::count_if(listed_samples->begin(), listed_samples->end(), [&stored_samples] (int sample)
+            {
+                return (std::binary_search(stored_samples.begin(), stored_samples.end(), sample) == false);
+            });
+        }
+
+        for(const NodePtr& node : compiled_graph.refOrderedNodes())
+        {
+            node_names.push_back(node->getName());
+        }
+
+        run_stats.reset(new RunStats(node_names, num_pending, myProgress));
+
+        if(myRunStats)
+        {
+            compiled_graph.setRunStats(run_stats.get());
+        }
     }
 
     // proceed with sampling.
@@ -299,157 +1271,185 @@ void Sampler::run( const std::vector<NodePtr>& graph, int num_samples, const std
         if(multithread)
         {
             tbb::flow::graph g;
+            PayloadWriter payload_writer;
+            tbb::concurrent_bounded_queue<size_t> free_lanes;
+            std::atomic<bool> failed(false);
+            SourceBody source_body(first_sample, end_sample, stored_samples, listed_samples, myConvergence.get());
+            PipelineController controller(&compiled_graph, &source_body, batch_capacity, myMemoryBudget, myTargetUtilization, &myPipelineDepth, &myPeakMemory, run_stats.get());
+            std::vector<SampleBatch*> issued;
+
+            for(size_t i=0; i<sinks.size(); i++)
+            {
+                free_lanes.push(i);
+            }
+
+            // the batches in flight are issued by the controller, which adapts the pipeline depth
+            // to the memory budget and to the utilization of the workers.
+
+            tbb::flow::function_node<SampleBatch*, SampleBatch*> sampler_node(g, 0, SamplerBody(&compiled_graph, mySeed, myNodeParallelism, &controller));
+            PayloadBody::PayloadNode payload_node(g, tbb::flow::unlimited, PayloadBody(&payload_writer));
+            tbb::flow::function_node<SampleBatch*, tbb::flow::continue_msg> export_node(g, (myOrderedExport) ? 1 : sinks.size(), ExportBody(sinks, &free_lanes, &controller, &sampler_node, run_stats.get(), myConvergence.get(), &failed, myOrderedExport));
+
+            // in ordered mode, the sequencer holds the batches computed ahead of the oldest one. They are at most
+            // as many as the batches in flight, since the controller only issues a batch once another one is exported.
 
-            tbb::flow::source_node<int> source_node(g, SourceBody(num_samples), false);
-            tbb::flow::limiter_node<int> limiter_node(g, 10);
+            tbb::flow::sequencer_node<SampleBatch*> sequencer_node(g, [] (SampleBatch* const& batch) { return batch->sequence; });
+            tbb::flow::receiver<SampleBatch*>* exporter = &export_node;
 
-            tbb::flow::function_node<int, ValueTablePtr> sampler_node(g, 0, SamplerBody(ordered_nodes, node_map, offset, value_factories));
-            tbb::flow::function_node<ValueTablePtr, tbb::flow::continue_msg> export_node(g, 1, ExportBody(insert_stmt));
+            if(myOrderedExport)
+            {
+                make_edge(sequencer_node, export_node);
+                exporter = &sequencer_node;
+            }
+
+            // payloads are saved on dedicated threads so that TBB workers never block on disk I/O.
+
+            if(compiled_graph.refPayloadValues().empty())
+            {
+                make_edge(sampler_node, *exporter);
+            }
+            else
+            {
+                payload_writer.setRunStats(run_stats.get());
+                payload_writer.start(&compiled_graph, myIOThreads, [&payload_node] (SampleBatch* batch)
+                {
+                    payload_node.gateway().try_put(batch);
+                    payload_node.gateway().release_wait();
+                });
 
-            make_edge(source_node, limiter_node);
-            make_edge(limiter_node, sampler_node);
-            make_edge(sampler_node, export_node);
-            make_edge(export_node, limiter_node.decrement);
+                make_edge(sampler_node, payload_node);
+                make_edge(payload_node, *exporter);
+            }
+
+            controller.start(issued);
+
+            for(SampleBatch* batch : issued)
+            {
+                sampler_node.try_put(batch);
+            }
 
-            source_node.activate();
             g.wait_for_all();
+
+            payload_writer.stop();
+
+            ok = (failed == false);
+            err = "Could not save sample!";
         }
         else
         {
-            for(int i=0; ok && i<num_samples; i++)
+            SourceBody source_body(first_sample, end_sample, stored_samples, listed_samples, myConvergence.get());
+            SampleBatch batch;
+            PayloadContext payload_context;
+
+            compiled_graph.createBatch(batch, batch_capacity);
+            myPipelineDepth = 1;
+
+            while(ok && source_body(batch))
             {
-                // compute sample.
+                // compute samples.
 
-                for(NodePtr node : ordered_nodes)
+                if(myNodeParallelism)
+                {
+                    compiled_graph.executeParallel(mySeed, batch);
+                }
+                else
                 {
-                    // gather input values.
+                    compiled_graph.execute(mySeed, batch);
+                }
 
-                    input_values.clear();
+                ok = (batch.failed == false);
+                err = "Could not read source sample!";
 
-                    for(std::string other_node_name : node->refDependencies())
-                    {
-                        NodePtr other_node = node_map[other_node_name];
+                myPeakMemory = std::max<size_t>(myPeakMemory, CompiledGraph::getMemorySize(batch));
 
-                        std::copy(
-                            values.begin() + offset[other_node_name],
-                            values.begin() + offset[other_node_name] + other_node->refValueFactories().size(),
-                            std::back_inserter(input_values));
-                    }
+                // save payloads, then samples.
 
-                    // gather output values.
+                uint64_t start = (run_stats) ? RunStats::getTime() : 0;
 
-                    output_values.clear();
+                if(compiled_graph.refPayloadValues().empty() == false)
+                {
+                    ok = PayloadWriter::save(&compiled_graph, batch, payload_context);
+                    err = "Could not save payload!";
 
-                    std::copy(
-                        values.begin() + offset[node->getName()],
-                        values.begin() + offset[node->getName()] + node->refValueFactories().size(),
-                        std::back_inserter(output_values));
+                    if(run_stats)
+                    {
+                        const uint64_t end = RunStats::getTime();
+                        run_stats->addPayload(batch.size, end - start);
+                        start = end;
+                    }
+                }
 
-                    // call sampling function.
+                for(size_t i=0; ok && i<batch.size; i++)
+                {
+                    const SampleRecord& record = batch.records[i];
+                    ok = sinks[record.sample % sinks.size()]->write(record.sample, record.values);
+                    err = "Could not save sample!";
 
-                    node->getSample(input_values, output_values);
+                    if(ok && myConvergence)
+                    {
+                        myConvergence->add(record.values);
+                    }
                 }
 
-                // save sample to database.
-
-                ok = saveSample(insert_stmt, values);
-                err = "Could not insert sample to database!";
+                if(run_stats)
+                {
+                    run_stats->addExport(batch.size, 0, RunStats::getTime() - start);
+                }
             }
         }
     }
 
-    if(ok)
-    {
-        ok = (SQLITE_OK == sqlite3_finalize(insert_stmt));
-        err = "Could not release insertion statement!";
-    }
+    // the statistics are saved to the first sink.
 
-    if(ok)
+    if(ok && run_stats)
     {
-        ok = (SQLITE_OK == sqlite3_close_v2(db));
-        err = "Could not close database!";
-        db = nullptr;
+        run_stats->finish(myPipelineDepth, myPeakMemory);
+        run_stats->getRecords(myStatRecords);
     }
 
-    if(ok == false)
+    if(ok && run_stats && myConvergence)
     {
-        std::cout << err << std::endl;
-        exit(1);
+        std::vector<StatRecord> records;
+        myConvergence->getRecords(records);
+        myStatRecords.insert(myStatRecords.end(), records.begin(), records.end());
     }
-}
-
-bool Sampler::saveSample(sqlite3_stmt* insert_stmt, const std::vector<ValuePtr>& values)
-{
-    sqlite3_reset(insert_stmt);
-
-    int field_offset = 1;
 
-    for(ValuePtr v : values)
+    if(ok && myRunStats)
     {
-        v->bind(insert_stmt, field_offset);
+        ok = sinks.front()->writeStats(myStatRecords);
+        err = "Could not save run statistics!";
     }
 
-    return (SQLITE_DONE == sqlite3_step(insert_stmt));
-}
-
-bool Sampler::reorderNodes(const std::vector<NodePtr>& graph, std::vector<NodePtr>& ordered_nodes)
-{
-    std::map< std::string, std::vector<NodePtr> > children;
-    std::set< std::string > processed;
-    std::stack<NodePtr> stack;
+    // whatever happened, every sink which was opened is closed, so that the samples already written are flushed.
 
-    for(NodePtr node : graph)
+    if(source_open)
     {
-        for(std::string parent : node->refDependencies())
+        const bool closed = source->close();
+
+        if(ok && closed == false)
         {
-            children[parent].push_back(node);
+            err = "Could not close source!";
         }
-    }
 
-    ordered_nodes.clear();
+        ok = ok && closed;
+    }
 
-    for(NodePtr root_node : graph)
+    for(size_t i=0; i<num_open_sinks; i++)
     {
-        if( processed.count(root_node->getName()) == 0 && root_node->refDependencies().empty() )
-        {
-            stack.push(root_node);
-            ordered_nodes.push_back(root_node);
-            processed.insert(root_node->getName());
-
-            while(stack.empty() == false)
-            {
-                NodePtr node = stack.top();
-                stack.pop();
+        const bool closed = sinks[i]->close();
 
-                for(NodePtr child : children[node->getName()])
-                {
-                    if(processed.count(child->getName()) == 0)
-                    {
-                        bool all_dependencies_available = true;
-                        for(std::string parent_name : child->refDependencies())
-                        {
-                            all_dependencies_available = all_dependencies_available && (processed.count(parent_name) > 0);
-                        }
-
-                        if(all_dependencies_available)
-                        {
-                            stack.push(child);
-                            ordered_nodes.push_back(child);
-                            processed.insert(child->getName());
-                        }
-                    }
-                }
-            }
+        if(ok && closed == false)
+        {
+            err = "Could not close sink!";
         }
+
+        ok = ok && closed;
     }
 
-    /*
-    for(NodePtr n : graph) std::cout << n->getName() << " ";
-    std::cout << std::endl;
-    for(NodePtr n : ordered_nodes) std::cout << n->getName() << " ";
-    std::cout << std::endl;
-    */
+    if(ok == false)
+    {
+        std::cout << err << std::endl;
+    }
 
-    return true;
+    return ok;
 }
-
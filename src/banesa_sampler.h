@@ -1,33 +1,180 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include "banesa_core.h"
+#include "banesa_sink.h"
+#include "banesa_compiled_graph.h"
+#include "banesa_convergence_monitor.h"
+
+// Creates the nodes of a graph.
+using GraphFactory = std::function< std::vector<NodePtr>() >;
 
 class Sampler
 {
 public:
 
-    void run( const std::vector<NodePtr>& graph, int num_samples, const std::string& db_path, bool multithread=false);
+    Sampler();
 
-private:
+    // Bulk-load settings of the SQLite sink created by run() when given a database path.
+    void setBulkLoad(bool bulk_load, int rows_per_transaction=10000, int rows_per_statement=100);
 
-    struct ValueTable
-    {
-        std::vector<ValuePtr> values;
-        int sample;
-    };
+    // Number of database shards written in parallel by run() when given a database path.
+    // Shard k is saved to <db_path>.<k>. If merge is true, the shards are merged into db_path at the end of the run.
+    void setShards(int num_shards, bool merge=true);
+
+    // Whether run() appends to the databases found at the given path instead of overwriting them.
+    // Samples already stored are skipped, which allows resuming or extending a previous run.
+    // With merged shards, the samples already merged into the database are skipped too, and the new ones are added to it.
+    void setAppend(bool append);
+
+    // Whether independent nodes of a sample are computed concurrently.
+    // This is useful for graphs with few expensive nodes, and can be combined with multithread mode.
+    void setNodeParallelism(bool node_parallelism);
+
+    // Seed of the random streams given to the nodes.
+    void setSeed(uint64_t seed);
+
+    // Number of threads saving the payloads of file values in multithread mode (see FileValueSerializer).
+    // Payloads are saved before the samples are exported, and the number of batches waiting for I/O is bounded by the pipeline depth.
+    void setIOThreads(int num_threads);
+
+    // Number of samples computed together by each call to Node::getSampleBatch().
+    // With fan-out (see Node::setMultiplicity()), it is the number of upstream samples per batch.
+    void setBatchSize(int batch_size);
+
+    // Bound on the memory held by the batches in flight in multithread mode, as reported by Value::getMemorySize().
+    // Zero means no bound. The pipeline depth never exceeds what the budget allows for the largest batch seen so far.
+    void setMemoryBudget(size_t bytes);
+
+    // Fraction of the time the workers should spend computing samples in multithread mode.
+    // The pipeline depth grows while the utilization is below the target and more batches in flight increase the throughput.
+    void setTargetUtilization(double utilization);
+
+    // Cache reusing the outputs of pure nodes (see Node::setPure()). Null by default, meaning that all the nodes are computed.
+    // The cache may be kept from one run to the next.
+    void setMemoCache(MemoCachePtr cache);
+
+    // Whether run() collects statistics (see RunStats) and saves them with the samples, in the run_stats table of SQLite sinks.
+    // The duration of every node call is measured, which adds some overhead to cheap nodes.
+    void setRunStats(bool run_stats);
+
+    // Whether run() prints the number of exported samples and the throughput every second.
+    void setProgress(bool progress);
+
+    // Whether the multithread mode exports the samples in increasing order, sample i going to sink i % number of sinks
+    // as in sequential mode. Runs with the same settings then produce the same databases, apart from the run_stats table.
+    // Batches computed ahead of a slow one wait for it, within the pipeline depth and the memory budget,
+    // and the sinks are written one batch at a time.
+    void setOrderedExport(bool ordered);
+
+    // Design of the points given to the nodes which declare design dimensions (see Node::setDesignDimensions()),
+    // planned over the num_samples samples of the run. Random by default. Sobol supports up to 21 dimensions in total.
+    // Only live nodes get design dimensions, hence dead nodes do not change the design of the others (see CompiledGraph).
+    void setDesign(DesignType type);
+
+    // Stopping rule, null by default. When set, run() stops issuing samples once the estimators of the monitor converge,
+    // num_samples being the largest number of samples. The samples in flight are still exported. Not used by runProcesses().
+    // The estimates are added to the statistics of the run, if enabled.
+    void setConvergence(ConvergenceMonitorPtr monitor);
+
+    // Statistics of the last run, if enabled.
+    const std::vector<StatRecord>& refRunStats();
+
+    // Number of batches allowed in flight, which adapts during the run. May be called from another thread.
+    int getPipelineDepth();
 
-    using ValueTablePtr = std::shared_ptr<ValueTable>;
+    // Largest memory held by the batches during the last run, in bytes. May be called from another thread.
+    size_t getPeakMemory();
 
+    bool run( const std::vector<NodePtr>& graph, int num_samples, const std::string& db_path, bool multithread=false);
+
+    bool run( const std::vector<NodePtr>& graph, int num_samples, SinkPtr sink, bool multithread=false);
+
+    // num_samples is the number of rows, hence the number of upstream samples with fan-out is num_samples / multiplicity, rounded up.
+    // Each sink is an export lane. In multithread mode, the lanes are written concurrently.
+    // Samples reported as already stored by the sinks are not computed again.
+    bool run( const std::vector<NodePtr>& graph, int num_samples, const std::vector<SinkPtr>& sinks, bool multithread=false);
+
+    // Forks num_processes worker processes, each of which creates its own nodes with the factory and samples a contiguous range
+    // of sample ids in sequential mode, into shard <db_path>.<k>. This suits nodes which are not thread-safe. The workers report
+    // their progress through pipes. The range of a worker which crashes is given to a new worker, which resumes the shard,
+    // up to three attempts per range. The shards are merged into db_path unless disabled with setShards(), whose number
+    // of shards is ignored. Node parallelism should not be enabled if TBB was used by the calling process.
+    bool runProcesses(const GraphFactory& factory, int num_samples, const std::string& db_path, int num_processes);
+
+    // Incremental re-evaluation of the samples of a previous run, after some nodes changed. The named nodes and their descendants
+    // are computed again, while the other nodes read their values from the source. Nodes whose values cannot be read back,
+    // like hidden values, packed file values or file values without decoder (see Value::read()), are computed as well, together with
+    // the ancestors they need. The seed must be that of the source run, so that recomputed nodes which did not change give the
+    // same results. The sinks receive complete samples with the same ids. Append mode resumes an interrupted re-evaluation.
+    bool runIncremental(const std::vector<NodePtr>& graph, const std::vector<std::string>& changed_nodes, SampleSourcePtr source, const std::vector<SinkPtr>& sinks, bool multithread=false);
+
+    // Same as above, the samples table of the database being the source and the results being saved to another table of the same database.
+    bool runIncremental(const std::vector<NodePtr>& graph, const std::vector<std::string>& changed_nodes, const std::string& db_path, const std::string& table, bool multithread=false);
+
+private:
+
+    // Batches of samples are recycled. The controller fills a free batch with sample indices using the source,
+    // the sampler computes it and the exporter writes it then releases it to the controller.
     class SourceBody;
+    class PipelineController;
     class SamplerBody;
+    class PayloadBody;
     class ExportBody;
+    class ProgressSink;
+
+    struct Worker
+    {
+        int first_sample;
+        int end_sample;
+        int num_samples;
+        std::string path;
+        int attempts;
+        int pid;
+        int fd;
+        int64_t done;
+    };
+
+    static const int max_worker_attempts = 3;
+
+private:
+
+    // samples the ids in [first_sample,end_sample). num_samples is the number of samples of the whole run, over which designs are planned.
+    // If source is not null, the samples are those of the source instead, and only the changed nodes are computed (see runIncremental()).
+    bool runRange( const std::vector<NodePtr>& graph, int first_sample, int end_sample, int num_samples, const std::vector<SinkPtr>& sinks, bool multithread, SampleSource* source, const std::vector<std::string>& changed_nodes);
+
+    bool startWorker(const GraphFactory& factory, Worker& worker);
+
+    bool runWorker(const GraphFactory& factory, const Worker& worker, int fd);
+
+    // ids of the samples of the database into which the shards are merged. Empty if it does not exist.
+    static bool getMergedSamples(const std::string& db_path, std::vector<int>& samples);
 
 private:
 
-    static bool initializeDatabase(const std::vector<NodePtr>& graph, sqlite3*& db, const std::string& db_path);
-    static bool createInsertionStatement(sqlite3* db, std::vector<ValueFactoryPtr>& values, sqlite3_stmt** stmt);
-    static bool reorderNodes(const std::vector<NodePtr>& graph, std::vector<NodePtr>& ordered_nodes);
-    static bool saveSample(sqlite3_stmt* insert_stmt, const std::vector<ValuePtr>& values);
+    bool myBulkLoad;
+    int myRowsPerTransaction;
+    int myRowsPerStatement;
+    int myNumShards;
+    bool myMergeShards;
+    bool myAppend;
+    uint64_t mySeed;
+    bool myNodeParallelism;
+    int myBatchSize;
+    int myIOThreads;
+    size_t myMemoryBudget;
+    double myTargetUtilization;
+    MemoCachePtr myMemoCache;
+    bool myRunStats;
+    bool myProgress;
+    bool myOrderedExport;
+    DesignType myDesign;
+    ConvergenceMonitorPtr myConvergence;
+    std::vector<StatRecord> myStatRecords;
+    std::vector<int> myMergedSamples;
+    std::atomic<int> myPipelineDepth;
+    std::atomic<size_t> myPeakMemory;
 };
 
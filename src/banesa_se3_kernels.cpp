@@ -0,0 +1,103 @@
+
+#include "banesa_se3_kernels_impl.h"
+
+const SE3KernelTable se3_scalar_kernels = makeKernelTable<ScalarPack>();
+
+SE3Kernels::SE3Kernels()
+{
+    myLevel = SIMDLevel::Scalar;
+    myTable = &se3_scalar_kernels;
+
+    // select the best available instruction set.
+
+    if(setLevel(SIMDLevel::AVX512) == false)
+    {
+        setLevel(SIMDLevel::AVX2);
+    }
+}
+
+bool SE3Kernels::setLevel(SIMDLevel level)
+{
+    const bool ok = isLevelAvailable(level);
+
+    if(ok)
+    {
+        myLevel = level;
+
+        switch(level)
+        {
+#ifdef BANESA_ENABLE_AVX2
+        case SIMDLevel::AVX2:
+            myTable = &se3_avx2_kernels;
+            break;
+#endif
+#ifdef BANESA_ENABLE_AVX512
+        case SIMDLevel::AVX512:
+            myTable = &se3_avx512_kernels;
+            break;
+#endif
+        default:
+            myTable = &se3_scalar_kernels;
+            break;
+        }
+    }
+
+    return ok;
+}
+
+SIMDLevel SE3Kernels::getLevel()
+{
+    return myLevel;
+}
+
+bool SE3Kernels::isLevelAvailable(SIMDLevel level)
+{
+    bool ret = false;
+
+    switch(level)
+    {
+    case SIMDLevel::Scalar:
+        ret = true;
+        break;
+#ifdef BANESA_ENABLE_AVX2
+    case SIMDLevel::AVX2:
+        ret = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        break;
+#endif
+#ifdef BANESA_ENABLE_AVX512
+    case SIMDLevel::AVX512:
+        ret = __builtin_cpu_supports("avx512f");
+        break;
+#endif
+    default:
+        ret = false;
+        break;
+    }
+
+    return ret;
+}
+
+void SE3Kernels::normalize(const SE3Batch& a)
+{
+    myTable->normalize(a);
+}
+
+void SE3Kernels::compose(const SE3Batch& a, const SE3Batch& b, const SE3Batch& result)
+{
+    myTable->compose(a, b, result);
+}
+
+void SE3Kernels::invert(const SE3Batch& a, const SE3Batch& result)
+{
+    myTable->invert(a, result);
+}
+
+void SE3Kernels::setRandomRotations(const double* u1, const double* u2, const double* u3, const SE3Batch& result)
+{
+    myTable->setRandomRotations(u1, u2, u3, result);
+}
+
+void SE3Kernels::getErrors(const SE3Batch& a, const SE3Batch& b, double* rotation_error, double* translation_error)
+{
+    myTable->getErrors(a, b, rotation_error, translation_error);
+}
@@ -0,0 +1,89 @@
+
+#pragma once
+
+#include "banesa_se3_value.h"
+
+// Component arrays of a batch of rigid body transformations. Results may be written in place of an input.
+
+struct SE3Batch
+{
+    SE3Batch(SE3Column& column, size_t size)
+    {
+        translation_x = column.getTranslationX();
+        translation_y = column.getTranslationY();
+        translation_z = column.getTranslationZ();
+        quaternion_w = column.getQuaternionW();
+        quaternion_i = column.getQuaternionI();
+        quaternion_j = column.getQuaternionJ();
+        quaternion_k = column.getQuaternionK();
+        this->size = size;
+    }
+
+    // batch holding a single value.
+    SE3Batch(SE3Value& value)
+    {
+        translation_x = &value.refTranslationX();
+        translation_y = &value.refTranslationY();
+        translation_z = &value.refTranslationZ();
+        quaternion_w = &value.refQuaternionW();
+        quaternion_i = &value.refQuaternionI();
+        quaternion_j = &value.refQuaternionJ();
+        quaternion_k = &value.refQuaternionK();
+        size = 1;
+    }
+
+    double* translation_x;
+    double* translation_y;
+    double* translation_z;
+    double* quaternion_w;
+    double* quaternion_i;
+    double* quaternion_j;
+    double* quaternion_k;
+    size_t size;
+};
+
+enum class SIMDLevel
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+struct SE3KernelTable;
+
+// Vectorized operations on batches of rigid body transformations.
+// Quaternions are expected to be normalized, except by normalize().
+// The instruction set is selected at runtime among those enabled at build time.
+
+class SE3Kernels
+{
+public:
+
+    SE3Kernels();
+
+    // Returns false if the level was not enabled at build time or is not supported by the processor.
+    bool setLevel(SIMDLevel level);
+
+    SIMDLevel getLevel();
+
+    static bool isLevelAvailable(SIMDLevel level);
+
+    void normalize(const SE3Batch& a);
+
+    // result = a * b, that is b followed by a.
+    void compose(const SE3Batch& a, const SE3Batch& b, const SE3Batch& result);
+
+    void invert(const SE3Batch& a, const SE3Batch& result);
+
+    // Sets the rotations to random rotations uniformly distributed on SO(3), leaving translations unchanged.
+    // u1, u2 and u3 hold uniform numbers in [0,1), one per transformation (Shoemake's method).
+    void setRandomRotations(const double* u1, const double* u2, const double* u3, const SE3Batch& result);
+
+    // Geodesic angle of the rotation between a and b in radians, and distance between their translations.
+    void getErrors(const SE3Batch& a, const SE3Batch& b, double* rotation_error, double* translation_error);
+
+private:
+
+    SIMDLevel myLevel;
+    const SE3KernelTable* myTable;
+};
@@ -0,0 +1,4 @@
+
+#include "banesa_se3_kernels_impl.h"
+
+const SE3KernelTable se3_avx2_kernels = makeKernelTable<AVX2Pack>();
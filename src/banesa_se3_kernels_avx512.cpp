@@ -0,0 +1,4 @@
+
+#include "banesa_se3_kernels_impl.h"
+
+const SE3KernelTable se3_avx512_kernels = makeKernelTable<AVX512Pack>();
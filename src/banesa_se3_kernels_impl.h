@@ -0,0 +1,460 @@
+
+#pragma once
+
+// Implementation of the SE(3) kernels, shared by the translation units of the different instruction sets.
+// Kernels are written once on top of a pack of doubles and instantiated for each instruction set.
+// Everything has internal linkage so that code compiled with different instruction sets is never merged.
+
+#include <cmath>
+#include <cstddef>
+#include "banesa_se3_kernels.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+struct SE3KernelTable
+{
+    void (*normalize)(const SE3Batch& a);
+    void (*compose)(const SE3Batch& a, const SE3Batch& b, const SE3Batch& result);
+    void (*invert)(const SE3Batch& a, const SE3Batch& result);
+    void (*setRandomRotations)(const double* u1, const double* u2, const double* u3, const SE3Batch& result);
+    void (*getErrors)(const SE3Batch& a, const SE3Batch& b, double* rotation_error, double* translation_error);
+};
+
+extern const SE3KernelTable se3_scalar_kernels;
+extern const SE3KernelTable se3_avx2_kernels;
+extern const SE3KernelTable se3_avx512_kernels;
+
+namespace
+{
+
+struct ScalarPack
+{
+    using Type = double;
+    using Mask = bool;
+
+    static constexpr size_t width = 1;
+
+    static Type load(const double* p) { return *p; }
+    static void store(double* p, Type x) { *p = x; }
+    static Type set(double x) { return x; }
+    static Type add(Type a, Type b) { return a + b; }
+    static Type sub(Type a, Type b) { return a - b; }
+    static Type mul(Type a, Type b) { return a * b; }
+    static Type div(Type a, Type b) { return a / b; }
+    static Type sqrt(Type a) { return std::sqrt(a); }
+    static Type fmadd(Type a, Type b, Type c) { return a * b + c; }
+    static Type min(Type a, Type b) { return (a < b) ? a : b; }
+    static Type max(Type a, Type b) { return (a < b) ? b : a; }
+    static Type abs(Type a) { return std::fabs(a); }
+    static Type round(Type a) { return std::nearbyint(a); }
+    static Mask less(Type a, Type b) { return a < b; }
+    static Mask equal(Type a, Type b) { return a == b; }
+    static Type select(Mask m, Type a, Type b) { return m ? a : b; }
+};
+
+#ifdef __AVX2__
+struct AVX2Pack
+{
+    using Type = __m256d;
+    using Mask = __m256d;
+
+    static constexpr size_t width = 4;
+
+    static Type load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Type x) { _mm256_storeu_pd(p, x); }
+    static Type set(double x) { return _mm256_set1_pd(x); }
+    static Type add(Type a, Type b) { return _mm256_add_pd(a, b); }
+    static Type sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+    static Type mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+    static Type div(Type a, Type b) { return _mm256_div_pd(a, b); }
+    static Type sqrt(Type a) { return _mm256_sqrt_pd(a); }
+    static Type fmadd(Type a, Type b, Type c) { return _mm256_fmadd_pd(a, b, c); }
+    static Type min(Type a, Type b) { return _mm256_min_pd(a, b); }
+    static Type max(Type a, Type b) { return _mm256_max_pd(a, b); }
+    static Type abs(Type a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static Type round(Type a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Mask less(Type a, Type b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Mask equal(Type a, Type b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static Type select(Mask m, Type a, Type b) { return _mm256_blendv_pd(b, a, m); }
+};
+#endif
+
+#ifdef __AVX512F__
+struct AVX512Pack
+{
+    using Type = __m512d;
+    using Mask = __mmask8;
+
+    static constexpr size_t width = 8;
+
+    static Type load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, Type x) { _mm512_storeu_pd(p, x); }
+    static Type set(double x) { return _mm512_set1_pd(x); }
+    static Type add(Type a, Type b) { return _mm512_add_pd(a, b); }
+    static Type sub(Type a, Type b) { return _mm512_sub_pd(a, b); }
+    static Type mul(Type a, Type b) { return _mm512_mul_pd(a, b); }
+    static Type div(Type a, Type b) { return _mm512_div_pd(a, b); }
+    static Type sqrt(Type a) { return _mm512_sqrt_pd(a); }
+    static Type fmadd(Type a, Type b, Type c) { return _mm512_fmadd_pd(a, b, c); }
+    static Type min(Type a, Type b) { return _mm512_min_pd(a, b); }
+    static Type max(Type a, Type b) { return _mm512_max_pd(a, b); }
+    static Type abs(Type a) { return _mm512_abs_pd(a); }
+    static Type round(Type a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Mask less(Type a, Type b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static Mask equal(Type a, Type b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static Type select(Mask m, Type a, Type b) { return _mm512_mask_blend_pd(m, b, a); }
+};
+#endif
+
+template<typename P>
+struct Vector3
+{
+    typename P::Type x;
+    typename P::Type y;
+    typename P::Type z;
+};
+
+template<typename P>
+struct Quaternion
+{
+    typename P::Type w;
+    typename P::Type i;
+    typename P::Type j;
+    typename P::Type k;
+};
+
+template<typename P>
+inline Vector3<P> loadTranslation(const SE3Batch& a, size_t index)
+{
+    return Vector3<P>{ P::load(a.translation_x + index), P::load(a.translation_y + index), P::load(a.translation_z + index) };
+}
+
+template<typename P>
+inline Quaternion<P> loadQuaternion(const SE3Batch& a, size_t index)
+{
+    return Quaternion<P>{ P::load(a.quaternion_w + index), P::load(a.quaternion_i + index), P::load(a.quaternion_j + index), P::load(a.quaternion_k + index) };
+}
+
+template<typename P>
+inline void storeTranslation(const SE3Batch& a, size_t index, const Vector3<P>& t)
+{
+    P::store(a.translation_x + index, t.x);
+    P::store(a.translation_y + index, t.y);
+    P::store(a.translation_z + index, t.z);
+}
+
+template<typename P>
+inline void storeQuaternion(const SE3Batch& a, size_t index, const Quaternion<P>& q)
+{
+    P::store(a.quaternion_w + index, q.w);
+    P::store(a.quaternion_i + index, q.i);
+    P::store(a.quaternion_j + index, q.j);
+    P::store(a.quaternion_k + index, q.k);
+}
+
+template<typename P>
+inline Vector3<P> cross(const Vector3<P>& a, const Vector3<P>& b)
+{
+    return Vector3<P>{
+        P::sub(P::mul(a.y, b.z), P::mul(a.z, b.y)),
+        P::sub(P::mul(a.z, b.x), P::mul(a.x, b.z)),
+        P::sub(P::mul(a.x, b.y), P::mul(a.y, b.x)) };
+}
+
+template<typename P>
+inline Quaternion<P> multiply(const Quaternion<P>& a, const Quaternion<P>& b)
+{
+    Quaternion<P> ret;
+    ret.w = P::sub(P::sub(P::sub(P::mul(a.w, b.w), P::mul(a.i, b.i)), P::mul(a.j, b.j)), P::mul(a.k, b.k));
+    ret.i = P::sub(P::add(P::add(P::mul(a.w, b.i), P::mul(a.i, b.w)), P::mul(a.j, b.k)), P::mul(a.k, b.j));
+    ret.j = P::add(P::add(P::sub(P::mul(a.w, b.j), P::mul(a.i, b.k)), P::mul(a.j, b.w)), P::mul(a.k, b.i));
+    ret.k = P::add(P::sub(P::add(P::mul(a.w, b.k), P::mul(a.i, b.j)), P::mul(a.j, b.i)), P::mul(a.k, b.w));
+    return ret;
+}
+
+// v + w t + u x t with t = 2 u x v, for a unit quaternion (w,u).
+template<typename P>
+inline Vector3<P> rotate(const Quaternion<P>& q, const Vector3<P>& v)
+{
+    const Vector3<P> u{ q.i, q.j, q.k };
+    const typename P::Type two = P::set(2.0);
+
+    Vector3<P> t = cross<P>(u, v);
+    t.x = P::mul(two, t.x);
+    t.y = P::mul(two, t.y);
+    t.z = P::mul(two, t.z);
+
+    const Vector3<P> c = cross<P>(u, t);
+
+    return Vector3<P>{
+        P::add(P::fmadd(q.w, t.x, v.x), c.x),
+        P::add(P::fmadd(q.w, t.y, v.y), c.y),
+        P::add(P::fmadd(q.w, t.z, v.z), c.z) };
+}
+
+// Sine and cosine of 2 pi u for u in [0,1]. The angle is reduced to [-pi/4,pi/4] around the nearest
+// multiple of pi/2, then the polynomials of the Cephes library are used.
+template<typename P>
+inline void sinCos2Pi(typename P::Type u, typename P::Type& sine, typename P::Type& cosine)
+{
+    using T = typename P::Type;
+
+    const T zero = P::set(0.0);
+    const T k = P::round(P::mul(u, P::set(4.0)));
+    const T x = P::mul(P::sub(u, P::mul(k, P::set(0.25))), P::set(6.283185307179586));
+    const T z = P::mul(x, x);
+
+    T ps = P::set(1.58962301576546568060e-10);
+    ps = P::fmadd(ps, z, P::set(-2.50507477628578072866e-8));
+    ps = P::fmadd(ps, z, P::set(2.75573136213857245213e-6));
+    ps = P::fmadd(ps, z, P::set(-1.98412698295895385996e-4));
+    ps = P::fmadd(ps, z, P::set(8.33333333332211858878e-3));
+    ps = P::fmadd(ps, z, P::set(-1.66666666666666307295e-1));
+
+    T pc = P::set(-1.13585365213876817300e-11);
+    pc = P::fmadd(pc, z, P::set(2.08757008419747316778e-9));
+    pc = P::fmadd(pc, z, P::set(-2.75573141792967388112e-7));
+    pc = P::fmadd(pc, z, P::set(2.48015872888517045348e-5));
+    pc = P::fmadd(pc, z, P::set(-1.38888888888730564116e-3));
+    pc = P::fmadd(pc, z, P::set(4.16666666666665929218e-2));
+
+    const T s = P::fmadd(P::mul(x, z), ps, x);
+    const T c = P::fmadd(P::mul(z, z), pc, P::fmadd(P::set(-0.5), z, P::set(1.0)));
+
+    // k is in {0,1,2,3,4}, the last one being the same as the first one.
+
+    const typename P::Mask k1 = P::equal(k, P::set(1.0));
+    const typename P::Mask k2 = P::equal(k, P::set(2.0));
+    const typename P::Mask k3 = P::equal(k, P::set(3.0));
+
+    sine = P::select(k1, c, P::select(k2, P::sub(zero, s), P::select(k3, P::sub(zero, c), s)));
+    cosine = P::select(k1, P::sub(zero, s), P::select(k2, P::sub(zero, c), P::select(k3, s, c)));
+}
+
+// atan(y/x) in [0,pi/2] for y >= 0 and x >= 0. The ratio is reduced to [0,1] by symmetry and
+// then to [-0.2,0.66] around pi/4, then the rational approximation of the Cephes library is used.
+template<typename P>
+inline typename P::Type atan2Positive(typename P::Type y, typename P::Type x)
+{
+    using T = typename P::Type;
+
+    const T one = P::set(1.0);
+    const T hi = P::max(P::max(x, y), P::set(1.0e-300));
+    T r = P::div(P::min(x, y), hi);
+
+    const typename P::Mask shifted = P::less(P::set(0.66), r);
+    r = P::select(shifted, P::div(P::sub(r, one), P::add(r, one)), r);
+
+    const T z = P::mul(r, r);
+
+    T p = P::set(-8.750608600031904122785e-1);
+    p = P::fmadd(p, z, P::set(-1.615753718733365076637e1));
+    p = P::fmadd(p, z, P::set(-7.500855792314704667340e1));
+    p = P::fmadd(p, z, P::set(-1.228866684490136173410e2));
+    p = P::fmadd(p, z, P::set(-6.485021904942025371773e1));
+
+    T q = P::add(z, P::set(2.485846490142306297962e1));
+    q = P::fmadd(q, z, P::set(1.650270098316988542046e2));
+    q = P::fmadd(q, z, P::set(4.328810604912902668951e2));
+    q = P::fmadd(q, z, P::set(4.853903996359136964868e2));
+    q = P::fmadd(q, z, P::set(1.945506571482613964425e2));
+
+    T a = P::fmadd(P::mul(r, z), P::div(p, q), r);
+    a = P::add(a, P::select(shifted, P::set(0.78539816339744830962), P::set(0.0)));
+
+    return P::select(P::less(x, y), P::sub(P::set(1.57079632679489661923), a), a);
+}
+
+// Each kernel processes the blocks of P::width transformations starting at begin and returns where it stopped.
+
+template<typename P>
+size_t normalizeBlocks(const SE3Batch& a, size_t begin)
+{
+    size_t i = begin;
+
+    for( ; i + P::width <= a.size; i += P::width)
+    {
+        Quaternion<P> q = loadQuaternion<P>(a, i);
+
+        const typename P::Type norm2 = P::fmadd(q.w, q.w, P::fmadd(q.i, q.i, P::fmadd(q.j, q.j, P::mul(q.k, q.k))));
+        const typename P::Type scale = P::div(P::set(1.0), P::sqrt(norm2));
+
+        q.w = P::mul(q.w, scale);
+        q.i = P::mul(q.i, scale);
+        q.j = P::mul(q.j, scale);
+        q.k = P::mul(q.k, scale);
+
+        storeQuaternion<P>(a, i, q);
+    }
+
+    return i;
+}
+
+template<typename P>
+size_t composeBlocks(const SE3Batch& a, const SE3Batch& b, const SE3Batch& result, size_t begin)
+{
+    size_t i = begin;
+
+    for( ; i + P::width <= result.size; i += P::width)
+    {
+        const Quaternion<P> qa = loadQuaternion<P>(a, i);
+        const Quaternion<P> qb = loadQuaternion<P>(b, i);
+        const Vector3<P> ta = loadTranslation<P>(a, i);
+        const Vector3<P> tb = loadTranslation<P>(b, i);
+
+        const Quaternion<P> q = multiply<P>(qa, qb);
+        Vector3<P> t = rotate<P>(qa, tb);
+        t.x = P::add(t.x, ta.x);
+        t.y = P::add(t.y, ta.y);
+        t.z = P::add(t.z, ta.z);
+
+        storeQuaternion<P>(result, i, q);
+        storeTranslation<P>(result, i, t);
+    }
+
+    return i;
+}
+
+template<typename P>
+size_t invertBlocks(const SE3Batch& a, const SE3Batch& result, size_t begin)
+{
+    size_t i = begin;
+    const typename P::Type zero = P::set(0.0);
+
+    for( ; i + P::width <= result.size; i += P::width)
+    {
+        Quaternion<P> q = loadQuaternion<P>(a, i);
+        const Vector3<P> t = loadTranslation<P>(a, i);
+
+        q.i = P::sub(zero, q.i);
+        q.j = P::sub(zero, q.j);
+        q.k = P::sub(zero, q.k);
+
+        Vector3<P> u = rotate<P>(q, t);
+        u.x = P::sub(zero, u.x);
+        u.y = P::sub(zero, u.y);
+        u.z = P::sub(zero, u.z);
+
+        storeQuaternion<P>(result, i, q);
+        storeTranslation<P>(result, i, u);
+    }
+
+    return i;
+}
+
+template<typename P>
+size_t setRandomRotationBlocks(const double* u1, const double* u2, const double* u3, const SE3Batch& result, size_t begin)
+{
+    size_t i = begin;
+
+    for( ; i + P::width <= result.size; i += P::width)
+    {
+        typename P::Type sin1;
+        typename P::Type cos1;
+        typename P::Type sin2;
+        typename P::Type cos2;
+
+        sinCos2Pi<P>(P::load(u2 + i), sin1, cos1);
+        sinCos2Pi<P>(P::load(u3 + i), sin2, cos2);
+
+        const typename P::Type x = P::load(u1 + i);
+        const typename P::Type a = P::sqrt(P::sub(P::set(1.0), x));
+        const typename P::Type b = P::sqrt(x);
+
+        Quaternion<P> q;
+        q.w = P::mul(b, cos2);
+        q.i = P::mul(a, sin1);
+        q.j = P::mul(a, cos1);
+        q.k = P::mul(b, sin2);
+
+        storeQuaternion<P>(result, i, q);
+    }
+
+    return i;
+}
+
+template<typename P>
+size_t getErrorBlocks(const SE3Batch& a, const SE3Batch& b, double* rotation_error, double* translation_error, size_t begin)
+{
+    size_t i = begin;
+
+    for( ; i + P::width <= a.size; i += P::width)
+    {
+        const Quaternion<P> qa = loadQuaternion<P>(a, i);
+        const Quaternion<P> qb = loadQuaternion<P>(b, i);
+        const Vector3<P> ta = loadTranslation<P>(a, i);
+        const Vector3<P> tb = loadTranslation<P>(b, i);
+
+        // rotation from a to b: conj(qa) * qb.
+
+        const Vector3<P> va{ qa.i, qa.j, qa.k };
+        const Vector3<P> vb{ qb.i, qb.j, qb.k };
+        const Vector3<P> c = cross<P>(va, vb);
+
+        const typename P::Type w = P::fmadd(qa.w, qb.w, P::fmadd(qa.i, qb.i, P::fmadd(qa.j, qb.j, P::mul(qa.k, qb.k))));
+        const typename P::Type x = P::sub(P::sub(P::mul(qa.w, vb.x), P::mul(qb.w, va.x)), c.x);
+        const typename P::Type y = P::sub(P::sub(P::mul(qa.w, vb.y), P::mul(qb.w, va.y)), c.y);
+        const typename P::Type z = P::sub(P::sub(P::mul(qa.w, vb.z), P::mul(qb.w, va.z)), c.z);
+
+        const typename P::Type dx = P::sub(ta.x, tb.x);
+        const typename P::Type dy = P::sub(ta.y, tb.y);
+        const typename P::Type dz = P::sub(ta.z, tb.z);
+
+        // the angle is 2 atan2(|v|, |w|), which is accurate for small angles and accounts for q and -q being the same rotation.
+
+        const typename P::Type norm = P::sqrt(P::fmadd(x, x, P::fmadd(y, y, P::mul(z, z))));
+
+        P::store(rotation_error + i, P::mul(P::set(2.0), atan2Positive<P>(norm, P::abs(w))));
+        P::store(translation_error + i, P::sqrt(P::fmadd(dx, dx, P::fmadd(dy, dy, P::mul(dz, dz)))));
+    }
+
+    return i;
+}
+
+// Full kernels: packs of P::width first, then the remaining transformations one by one.
+
+template<typename P>
+void normalizeAll(const SE3Batch& a)
+{
+    normalizeBlocks<ScalarPack>(a, normalizeBlocks<P>(a, 0));
+}
+
+template<typename P>
+void composeAll(const SE3Batch& a, const SE3Batch& b, const SE3Batch& result)
+{
+    composeBlocks<ScalarPack>(a, b, result, composeBlocks<P>(a, b, result, 0));
+}
+
+template<typename P>
+void invertAll(const SE3Batch& a, const SE3Batch& result)
+{
+    invertBlocks<ScalarPack>(a, result, invertBlocks<P>(a, result, 0));
+}
+
+template<typename P>
+void setRandomRotationsAll(const double* u1, const double* u2, const double* u3, const SE3Batch& result)
+{
+    setRandomRotationBlocks<ScalarPack>(u1, u2, u3, result, setRandomRotationBlocks<P>(u1, u2, u3, result, 0));
+}
+
+template<typename P>
+void getErrorsAll(const SE3Batch& a, const SE3Batch& b, double* rotation_error, double* translation_error)
+{
+    getErrorBlocks<ScalarPack>(a, b, rotation_error, translation_error, getErrorBlocks<P>(a, b, rotation_error, translation_error, 0));
+}
+
+template<typename P>
+SE3KernelTable makeKernelTable()
+{
+    SE3KernelTable ret;
+    ret.normalize = normalizeAll<P>;
+    ret.compose = composeAll<P>;
+    ret.invert = invertAll<P>;
+    ret.setRandomRotations = setRandomRotationsAll<P>;
+    ret.getErrors = getErrorsAll<P>;
+    return ret;
+}
+
+}
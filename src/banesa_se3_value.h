@@ -3,107 +3,271 @@
 
 #include "banesa_core.h"
 
+// Rigid body transformation. The seven components are stored either in the value itself
+// or in an SE3Column, in which case consecutive components are separated by the size of the column.
+
 class SE3Value : public Value
 {
 public:
 
     SE3Value(ValueFactoryPtr factory) : Value(factory)
     {
-        myTranslationX = 0.0;
-        myTranslationY = 0.0;
-        myTranslationZ = 0.0;
-        myQuaternionW = 0.0;
-        myQuaternionI = 0.0;
-        myQuaternionJ = 0.0;
-        myQuaternionK = 0.0;
+        for(double& x : myLocal)
+        {
+            x = 0.0;
+        }
+
+        myStorage = myLocal;
+        myStride = 1;
+    }
+
+    // value stored in a column.
+    SE3Value(ValueFactoryPtr factory, double* storage, size_t stride) : Value(factory)
+    {
+        for(double& x : myLocal)
+        {
+            x = 0.0;
+        }
+
+        myStorage = storage;
+        myStride = stride;
     }
 
+    SE3Value(const SE3Value& other) = delete;
+
+    SE3Value& operator=(const SE3Value& other) = delete;
+
     double& refTranslationX()
     {
-        return myTranslationX;
+        return myStorage[0*myStride];
+    }
+
+    const double& refTranslationX() const
+    {
+        return myStorage[0*myStride];
     }
 
     double& refTranslationY()
     {
-        return myTranslationY;
+        return myStorage[1*myStride];
+    }
+
+    const double& refTranslationY() const
+    {
+        return myStorage[1*myStride];
     }
 
     double& refTranslationZ()
     {
-        return myTranslationZ;
+        return myStorage[2*myStride];
+    }
+
+    const double& refTranslationZ() const
+    {
+        return myStorage[2*myStride];
     }
 
     double& refQuaternionW()
     {
-        return myQuaternionW;
+        return myStorage[3*myStride];
+    }
+
+    const double& refQuaternionW() const
+    {
+        return myStorage[3*myStride];
     }
 
     double& refQuaternionI()
     {
-        return myQuaternionI;
+        return myStorage[4*myStride];
+    }
+
+    const double& refQuaternionI() const
+    {
+        return myStorage[4*myStride];
     }
 
     double& refQuaternionJ()
     {
-        return myQuaternionJ;
+        return myStorage[5*myStride];
+    }
+
+    const double& refQuaternionJ() const
+    {
+        return myStorage[5*myStride];
     }
 
     double& refQuaternionK()
     {
-        return myQuaternionK;
+        return myStorage[6*myStride];
+    }
+
+    const double& refQuaternionK() const
+    {
+        return myStorage[6*myStride];
+    }
+
+    void write(FieldWriter& writer, int& offset) override
+    {
+        for(int i=0; i<7; i++)
+        {
+            writer.writeReal(offset+i, myStorage[i*myStride]);
+        }
+
+        offset += 7;
     }
 
-    void bind(sqlite3_stmt* stmt, int& offset) override
+    bool read(FieldReader& reader, int& offset) override
     {
-        sqlite3_bind_double(stmt, offset+0, myTranslationX);
-        sqlite3_bind_double(stmt, offset+1, myTranslationY);
-        sqlite3_bind_double(stmt, offset+2, myTranslationZ);
-        sqlite3_bind_double(stmt, offset+3, myQuaternionW);
-        sqlite3_bind_double(stmt, offset+4, myQuaternionI);
-        sqlite3_bind_double(stmt, offset+5, myQuaternionJ);
-        sqlite3_bind_double(stmt, offset+6, myQuaternionK);
+        bool ok = true;
+
+        for(int i=0; ok && i<7; i++)
+        {
+            ok = reader.readReal(offset+i, myStorage[i*myStride]);
+        }
+
         offset += 7;
+
+        return ok;
+    }
+
+    size_t getMemorySize() const override
+    {
+        return sizeof(SE3Value) + (myStorage == myLocal ? 0 : 7*sizeof(double));
+    }
+
+    bool isComparable() const override
+    {
+        return true;
+    }
+
+    uint64_t getHash() const override
+    {
+        uint64_t ret = 0;
+
+        for(int i=0; i<7; i++)
+        {
+            ret = combineHash(ret, ValueContent<double>::hash(myStorage[i*myStride]));
+        }
+
+        return ret;
+    }
+
+    bool isEqual(const Value& other) const override
+    {
+        const SE3Value& other_se3 = static_cast<const SE3Value&>(other);
+        bool ret = true;
+
+        for(int i=0; ret && i<7; i++)
+        {
+            ret = (myStorage[i*myStride] == other_se3.myStorage[i*other_se3.myStride]);
+        }
+
+        return ret;
+    }
+
+    void assign(const Value& other) override
+    {
+        const SE3Value& other_se3 = static_cast<const SE3Value&>(other);
+
+        for(int i=0; i<7; i++)
+        {
+            myStorage[i*myStride] = other_se3.myStorage[i*other_se3.myStride];
+        }
     }
 
 protected:
 
-    double myTranslationX;
-    double myTranslationY;
-    double myTranslationZ;
-    double myQuaternionW;
-    double myQuaternionI;
-    double myQuaternionJ;
-    double myQuaternionK;
+    double myLocal[7];
+    double* myStorage;
+    size_t myStride;
 };
 
-class SE3ValueFactory : public ValueFactory
+// Values of a batch stored as seven contiguous arrays, one per component.
+
+class SE3Column : public ValueColumn
 {
 public:
 
-    SE3ValueFactory(const std::string& name) : ValueFactory(name)
+    SE3Column(ValueFactoryPtr factory, size_t size) : myData(7*size, 0.0)
     {
+        mySize = size;
+        myValues.resize(size);
+
+        for(size_t i=0; i<size; i++)
+        {
+            myValues[i] = std::make_shared<SE3Value>(factory, &myData[i], size);
+        }
+    }
+
+    double* getTranslationX()
+    {
+        return myData.data() + 0*mySize;
+    }
+
+    double* getTranslationY()
+    {
+        return myData.data() + 1*mySize;
+    }
+
+    double* getTranslationZ()
+    {
+        return myData.data() + 2*mySize;
     }
 
-    void getSqlFieldNames(std::vector<std::string>& names) override
+    double* getQuaternionW()
     {
-        names.clear();
-        names.push_back( getName() + "_translation_x" );
-        names.push_back( getName() + "_translation_y" );
-        names.push_back( getName() + "_translation_z" );
-        names.push_back( getName() + "_quaternion_w" );
-        names.push_back( getName() + "_quaternion_i" );
-        names.push_back( getName() + "_quaternion_j" );
-        names.push_back( getName() + "_quaternion_k" );
+        return myData.data() + 3*mySize;
     }
 
-    void getSqlFieldTypes(std::vector<std::string>& sqltypes) override
+    double* getQuaternionI()
     {
-        sqltypes.assign({"FLOAT", "FLOAT", "FLOAT", "FLOAT", "FLOAT", "FLOAT", "FLOAT"});
+        return myData.data() + 4*mySize;
+    }
+
+    double* getQuaternionJ()
+    {
+        return myData.data() + 5*mySize;
+    }
+
+    double* getQuaternionK()
+    {
+        return myData.data() + 6*mySize;
+    }
+
+protected:
+
+    std::vector<double> myData;
+    size_t mySize;
+};
+
+class SE3ValueFactory : public ValueFactory
+{
+public:
+
+    SE3ValueFactory(const std::string& name) : ValueFactory(name)
+    {
+    }
+
+    void getFields(std::vector<Field>& fields) override
+    {
+        fields.clear();
+        fields.push_back( Field{getName() + "_translation_x", FieldType::Real} );
+        fields.push_back( Field{getName() + "_translation_y", FieldType::Real} );
+        fields.push_back( Field{getName() + "_translation_z", FieldType::Real} );
+        fields.push_back( Field{getName() + "_quaternion_w", FieldType::Real} );
+        fields.push_back( Field{getName() + "_quaternion_i", FieldType::Real} );
+        fields.push_back( Field{getName() + "_quaternion_j", FieldType::Real} );
+        fields.push_back( Field{getName() + "_quaternion_k", FieldType::Real} );
     }
 
     ValuePtr createValue() override
     {
         return std::make_shared<SE3Value>(shared_from_this());
     }
-};
 
+    ValueColumnPtr createColumn(size_t size) override
+    {
+        return std::make_shared<SE3Column>(shared_from_this(), size);
+    }
+};
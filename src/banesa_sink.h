@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include "banesa_core.h"
+
+// Statistic of a run (see RunStats). The bucket is the index of the histogram bucket or of the time step, -1 for scalars.
+
+struct StatRecord
+{
+    std::string category;
+    std::string name;
+    std::string metric;
+    int bucket;
+    double value;
+};
+
+// A sink receives the samples produced by the sampler and stores them.
+// The fields are described once when the sink is opened and each sample
+// is then written as the list of values of the graph, in the order of the fields.
+
+class Sink
+{
+public:
+
+    virtual ~Sink()
+    {
+    }
+
+    virtual bool open(const std::vector<Field>& fields) = 0;
+
+    virtual bool write(int sample, const std::vector<ValuePtr>& values) = 0;
+
+    // Samples which were already stored before the sink was opened, in increasing order.
+    // Sinks which do not support appending to previous results report none.
+    virtual bool getStoredSamples(std::vector<int>& samples)
+    {
+        samples.clear();
+        return true;
+    }
+
+    // Stores the statistics of the run before the sink is closed. Sinks which do not support it ignore them.
+    virtual bool writeStats(const std::vector<StatRecord>& records)
+    {
+        return true;
+    }
+
+    virtual bool close() = 0;
+};
+
+using SinkPtr = std::shared_ptr<Sink>;
+
+// Samples stored by a previous run, read back by incremental re-evaluation (see Sampler::runIncremental()).
+
+class SampleSource
+{
+public:
+
+    virtual ~SampleSource()
+    {
+    }
+
+    // Matches the fields of the graph with the stored ones. Fields which are not stored are read as missing.
+    virtual bool open(const std::vector<Field>& fields) = 0;
+
+    // Stored samples, in increasing order.
+    virtual bool getSamples(std::vector<int>& samples) = 0;
+
+    // Calls the callback with the fields of the sample, whose columns are those of the graph.
+    // Returns false if the sample is not stored or if the callback fails. May be called concurrently.
+    virtual bool read(int sample, const std::function<bool(FieldReader&)>& callback) = 0;
+
+    virtual bool close() = 0;
+};
+
+using SampleSourcePtr = std::shared_ptr<SampleSource>;
@@ -0,0 +1,693 @@
+#include <sstream>
+#include <algorithm>
+#include "banesa_sqlite_sink.h"
+
+class SQLiteSink::RowBuffer : public FieldWriter
+{
+public:
+
+    RowBuffer(const std::vector<Field>& fields, size_t max_rows) : myFields(fields)
+    {
+        myCells.resize(fields.size() * max_rows);
+        myNumRows = 0;
+        myBase = 0;
+        myBorrowBlobs = (max_rows == 1);
+    }
+
+    void beginRow()
+    {
+        myBase = myNumRows * myFields.size();
+        myNumRows++;
+    }
+
+    size_t getNumRows()
+    {
+        return myNumRows;
+    }
+
+    void clear()
+    {
+        myNumRows = 0;
+    }
+
+    void writeInteger(int column, int64_t value) override
+    {
+        myCells[myBase + column].integer = value;
+    }
+
+    void writeReal(int column, double value) override
+    {
+        myCells[myBase + column].real = value;
+    }
+
+    void writeText(int column, const std::string& value) override
+    {
+        myCells[myBase + column].text = value;
+    }
+
+    void writeBlob(int column, const void* data, size_t size) override
+    {
+        Cell& cell = myCells[myBase + column];
+
+        // a single pending row is inserted before the sink returns from write(), while the value still holds the data.
+        // Otherwise, the data is copied once into the cell.
+
+        if(myBorrowBlobs)
+        {
+            cell.blob = data;
+        }
+        else
+        {
+            cell.bytes.assign(static_cast<const char*>(data), static_cast<const char*>(data) + size);
+            cell.blob = cell.bytes.data();
+        }
+
+        cell.blob_size = size;
+    }
+
+    void bind(sqlite3_stmt* stmt, size_t first_row, size_t num_rows)
+    {
+        int parameter = 1;
+
+        for(size_t i=first_row; i<first_row+num_rows; i++)
+        {
+            for(size_t j=0; j<myFields.size(); j++)
+            {
+                Cell& cell = myCells[i*myFields.size() + j];
+
+                // cells are left untouched until the statement is stepped, hence SQLITE_STATIC.
+
+                switch(myFields[j].type)
+                {
+                case FieldType::Integer:
+                    sqlite3_bind_int64(stmt, parameter, cell.integer);
+                    break;
+                case FieldType::Real:
+                    sqlite3_bind_double(stmt, parameter, cell.real);
+                    break;
+                case FieldType::Text:
+                    sqlite3_bind_text(stmt, parameter, cell.text.c_str(), cell.text.size(), SQLITE_STATIC);
+                    break;
+                case FieldType::Blob:
+                    sqlite3_bind_blob64(stmt, parameter, cell.blob, cell.blob_size, SQLITE_STATIC);
+                    break;
+                }
+
+                parameter++;
+            }
+        }
+    }
+
+protected:
+
+    struct Cell
+    {
+        int64_t integer;
+        double real;
+        std::string text;
+        const void* blob;
+        size_t blob_size;
+        std::vector<char> bytes;
+    };
+
+    const std::vector<Field>& myFields;
+    std::vector<Cell> myCells;
+    size_t myNumRows;
+    size_t myBase;
+    bool myBorrowBlobs;
+};
+
+static const char* getSqlType(FieldType type)
+{
+    const char* ret = "";
+
+    switch(type)
+    {
+    case FieldType::Integer:
+        ret = "INTEGER";
+        break;
+    case FieldType::Real:
+        ret = "FLOAT";
+        break;
+    case FieldType::Text:
+        ret = "TEXT";
+        break;
+    case FieldType::Blob:
+        ret = "BLOB";
+        break;
+    }
+
+    return ret;
+}
+
+SQLiteSink::SQLiteSink(const std::string& path)
+{
+    myPath = path;
+    myTable = "samples";
+    myBulkLoad = false;
+    myAppend = false;
+    myRowsPerTransaction = 10000;
+    myRowsPerStatement = 100;
+    myDatabase = nullptr;
+    mySingleStatement = nullptr;
+    myMultiStatement = nullptr;
+    myMaxPendingRows = 1;
+    myTransactionRows = 0;
+}
+
+SQLiteSink::~SQLiteSink()
+{
+    if(myDatabase != nullptr)
+    {
+        sqlite3_finalize(mySingleStatement);
+        sqlite3_finalize(myMultiStatement);
+        sqlite3_close_v2(myDatabase);
+    }
+}
+
+void SQLiteSink::setBulkLoad(bool bulk_load, int rows_per_transaction, int rows_per_statement)
+{
+    myBulkLoad = bulk_load;
+    myRowsPerTransaction = rows_per_transaction;
+    myRowsPerStatement = rows_per_statement;
+}
+
+void SQLiteSink::setAppend(bool append)
+{
+    myAppend = append;
+}
+
+void SQLiteSink::setTable(const std::string& table)
+{
+    myTable = table;
+}
+
+bool SQLiteSink::open(const std::vector<Field>& fields)
+{
+    bool ok = true;
+
+    myFields.assign({ Field{"id", FieldType::Integer} });
+    myFields.insert(myFields.end(), fields.begin(), fields.end());
+    myMaxPendingRows = 1;
+    myTransactionRows = 0;
+
+    if(ok)
+    {
+        ok = initializeDatabase();
+    }
+
+    // compute how many rows are inserted per statement.
+
+    if(ok && myBulkLoad)
+    {
+        const size_t max_variables = sqlite3_limit(myDatabase, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+        const size_t max_rows = std::max<size_t>(1, max_variables / std::max<size_t>(1, myFields.size()));
+
+        myMaxPendingRows = std::min<size_t>(max_rows, std::max(1, myRowsPerStatement));
+    }
+
+    if(ok)
+    {
+        ok = createInsertionStatement(1, &mySingleStatement);
+    }
+
+    if(ok && myMaxPendingRows > 1)
+    {
+        ok = createInsertionStatement(myMaxPendingRows, &myMultiStatement);
+    }
+
+    if(ok)
+    {
+        myRowBuffer.reset(new RowBuffer(myFields, myMaxPendingRows));
+    }
+
+    return ok;
+}
+
+bool SQLiteSink::write(int sample, const std::vector<ValuePtr>& values)
+{
+    bool ok = true;
+
+    myRowBuffer->beginRow();
+    myRowBuffer->writeInteger(0, sample);
+
+    int field_offset = 1;
+
+    for(const ValuePtr& v : values)
+    {
+        v->write(*myRowBuffer, field_offset);
+    }
+
+    if(myRowBuffer->getNumRows() >= myMaxPendingRows)
+    {
+        ok = flushRows();
+    }
+
+    return ok;
+}
+
+bool SQLiteSink::getStoredSamples(std::vector<int>& samples)
+{
+    bool ok = true;
+    sqlite3_stmt* stmt = nullptr;
+    int ret = SQLITE_ROW;
+
+    samples.clear();
+
+    if(ok)
+    {
+        const std::string query = "SELECT id FROM " + myTable + " ORDER BY id";
+        ok = (SQLITE_OK == sqlite3_prepare_v2(myDatabase, query.c_str(), -1, &stmt, nullptr));
+    }
+
+    while(ok && (ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        samples.push_back(sqlite3_column_int(stmt, 0));
+    }
+
+    ok = ok && (ret == SQLITE_DONE);
+
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+bool SQLiteSink::writeStats(const std::vector<StatRecord>& records)
+{
+    bool ok = true;
+    sqlite3_stmt* stmt = nullptr;
+
+    // the statistics describe the last run, hence they replace those of a previous run.
+
+    if(ok)
+    {
+        ok = flushRows();
+    }
+
+    if(ok && myBulkLoad && myTransactionRows > 0)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, "COMMIT", nullptr, nullptr, nullptr));
+        myTransactionRows = 0;
+    }
+
+    if(ok)
+    {
+        const char* query =
+            "BEGIN TRANSACTION;"
+            "DROP TABLE IF EXISTS run_stats;"
+            "CREATE TABLE run_stats(shard INTEGER, category TEXT, name TEXT, metric TEXT, bucket INTEGER, value REAL);";
+
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, query, nullptr, nullptr, nullptr));
+    }
+
+    // the shard column has the same schema as a merged database, the shard index being set by merge().
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_prepare_v2(myDatabase, "INSERT INTO run_stats VALUES(0, ?, ?, ?, ?, ?)", -1, &stmt, nullptr));
+    }
+
+    for(size_t i=0; ok && i<records.size(); i++)
+    {
+        const StatRecord& record = records[i];
+
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, record.category.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, record.name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, record.metric.c_str(), -1, SQLITE_STATIC);
+
+        if(record.bucket >= 0)
+        {
+            sqlite3_bind_int(stmt, 4, record.bucket);
+        }
+        else
+        {
+            sqlite3_bind_null(stmt, 4);
+        }
+
+        sqlite3_bind_double(stmt, 5, record.value);
+
+        ok = (SQLITE_DONE == sqlite3_step(stmt));
+    }
+
+    sqlite3_finalize(stmt);
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, "COMMIT", nullptr, nullptr, nullptr));
+    }
+
+    return ok;
+}
+
+bool SQLiteSink::close()
+{
+    bool ok = true;
+
+    if(ok)
+    {
+        ok = flushRows();
+    }
+
+    if(ok && myBulkLoad && myTransactionRows > 0)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, "COMMIT", nullptr, nullptr, nullptr));
+        myTransactionRows = 0;
+    }
+
+    if(ok && myBulkLoad)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, "PRAGMA wal_checkpoint(TRUNCATE)", nullptr, nullptr, nullptr));
+    }
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_finalize(mySingleStatement)) && (SQLITE_OK == sqlite3_finalize(myMultiStatement));
+        mySingleStatement = nullptr;
+        myMultiStatement = nullptr;
+    }
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_close_v2(myDatabase));
+        myDatabase = nullptr;
+    }
+
+    return ok;
+}
+
+bool SQLiteSink::merge(const std::string& path, const std::vector<std::string>& shard_paths, bool append)
+{
+    bool ok = true;
+    sqlite3* db = nullptr;
+    sqlite3_stmt* stmt = nullptr;
+    std::string schema;
+    std::string existing_schema;
+
+    if(ok)
+    {
+        ok = (shard_paths.empty() == false);
+    }
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, nullptr));
+    }
+
+    if(ok)
+    {
+        const char* query =
+            "PRAGMA journal_mode=WAL;"
+            "PRAGMA synchronous=NORMAL;"
+            "PRAGMA temp_store=MEMORY;"
+            "PRAGMA cache_size=-65536;"
+            "DROP TABLE IF EXISTS run_stats;"
+            "CREATE TABLE run_stats(shard INTEGER, category TEXT, name TEXT, metric TEXT, bucket INTEGER, value REAL);";
+
+        ok = (SQLITE_OK == sqlite3_exec(db, query, nullptr, nullptr, nullptr));
+    }
+
+    if(ok && append == false)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(db, "DROP TABLE IF EXISTS samples", nullptr, nullptr, nullptr));
+    }
+
+    // in append mode, the samples merged by a previous run are kept.
+
+    if(ok && append)
+    {
+        sqlite3_stmt* schema_stmt = nullptr;
+
+        ok = (SQLITE_OK == sqlite3_prepare_v2(db, "SELECT sql FROM main.sqlite_master WHERE type='table' AND name='samples'", -1, &schema_stmt, nullptr));
+
+        if(ok && sqlite3_step(schema_stmt) == SQLITE_ROW)
+        {
+            existing_schema = reinterpret_cast<const char*>(sqlite3_column_text(schema_stmt, 0));
+        }
+
+        sqlite3_finalize(schema_stmt);
+    }
+
+    // retrieve the schema of the samples table from the first shard.
+
+    if(ok)
+    {
+        const std::string query = "ATTACH DATABASE ? AS shard";
+        ok = (SQLITE_OK == sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr));
+    }
+
+    for(size_t i=0; ok && i<shard_paths.size(); i++)
+    {
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, shard_paths[i].c_str(), -1, SQLITE_TRANSIENT);
+        ok = (SQLITE_DONE == sqlite3_step(stmt));
+
+        if(ok && i == 0)
+        {
+            sqlite3_stmt* schema_stmt = nullptr;
+
+            ok = (SQLITE_OK == sqlite3_prepare_v2(db, "SELECT sql FROM shard.sqlite_master WHERE type='table' AND name='samples'", -1, &schema_stmt, nullptr));
+
+            if(ok)
+            {
+                ok = (SQLITE_ROW == sqlite3_step(schema_stmt));
+            }
+
+            if(ok)
+            {
+                schema = reinterpret_cast<const char*>(sqlite3_column_text(schema_stmt, 0));
+            }
+
+            sqlite3_finalize(schema_stmt);
+
+            // an existing table must have the same fields as the shards.
+
+            if(ok && existing_schema.empty())
+            {
+                ok = (SQLITE_OK == sqlite3_exec(db, schema.c_str(), nullptr, nullptr, nullptr));
+            }
+            else if(ok)
+            {
+                ok = (existing_schema == schema);
+            }
+        }
+
+        // the statistics are saved by each worker process, or only in the first shard by a single process.
+
+        if(ok)
+        {
+            sqlite3_stmt* stats_stmt = nullptr;
+            bool has_stats = false;
+
+            ok = (SQLITE_OK == sqlite3_prepare_v2(db, "SELECT name FROM shard.sqlite_master WHERE type='table' AND name='run_stats'", -1, &stats_stmt, nullptr));
+
+            if(ok)
+            {
+                has_stats = (sqlite3_step(stats_stmt) == SQLITE_ROW);
+            }
+
+            sqlite3_finalize(stats_stmt);
+
+            if(ok && has_stats)
+            {
+                const std::string query = "INSERT INTO main.run_stats SELECT " + std::to_string(i) + ", category, name, metric, bucket, value FROM shard.run_stats";
+                ok = (SQLITE_OK == sqlite3_exec(db, query.c_str(), nullptr, nullptr, nullptr));
+            }
+        }
+
+        // bulk copy the rows of the shard.
+
+        if(ok)
+        {
+            const char* query =
+                "BEGIN TRANSACTION;"
+                "INSERT INTO main.samples SELECT * FROM shard.samples;"
+                "COMMIT;";
+
+            ok = (SQLITE_OK == sqlite3_exec(db, query, nullptr, nullptr, nullptr));
+        }
+
+        if(ok)
+        {
+            ok = (SQLITE_OK == sqlite3_exec(db, "DETACH DATABASE shard", nullptr, nullptr, nullptr));
+        }
+    }
+
+    sqlite3_finalize(stmt);
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE)", nullptr, nullptr, nullptr));
+    }
+
+    if(db != nullptr)
+    {
+        ok = (SQLITE_OK == sqlite3_close_v2(db)) && ok;
+    }
+
+    return ok;
+}
+
+bool SQLiteSink::initializeDatabase()
+{
+    std::stringstream query;
+
+    if(myBulkLoad)
+    {
+        query << "PRAGMA journal_mode=WAL;";
+        query << "PRAGMA synchronous=" << (myAppend ? "FULL" : "NORMAL") << ";";
+        query << "PRAGMA temp_store=MEMORY;";
+        query << "PRAGMA cache_size=-65536;";
+    }
+
+    if(myAppend)
+    {
+        query << "CREATE TABLE IF NOT EXISTS " << myTable << "(id INTEGER PRIMARY KEY";
+    }
+    else
+    {
+        query << "DROP TABLE IF EXISTS " << myTable << ";";
+        query << "CREATE TABLE " << myTable << "(id INTEGER PRIMARY KEY";
+    }
+
+    for(size_t i=1; i<myFields.size(); i++)
+    {
+        query << ", " << myFields[i].name << " " << getSqlType(myFields[i].type);
+    }
+    query << ");";
+
+    bool ok = true;
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_open_v2(myPath.c_str(), &myDatabase, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, nullptr));
+    }
+
+    // the database may be read by a SQLiteSource of the same run.
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_busy_timeout(myDatabase, 10000));
+    }
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, query.str().c_str(), nullptr, nullptr, nullptr));
+    }
+
+    if(ok && myAppend)
+    {
+        ok = checkSchema();
+    }
+
+    return ok;
+}
+
+bool SQLiteSink::checkSchema()
+{
+    bool ok = true;
+    sqlite3_stmt* stmt = nullptr;
+    size_t num_columns = 0;
+    int ret = SQLITE_ROW;
+
+    if(ok)
+    {
+        const std::string query = "PRAGMA table_info(" + myTable + ")";
+        ok = (SQLITE_OK == sqlite3_prepare_v2(myDatabase, query.c_str(), -1, &stmt, nullptr));
+    }
+
+    while(ok && (ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const std::string type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+
+        ok = (num_columns < myFields.size() && name == myFields[num_columns].name && type == getSqlType(myFields[num_columns].type));
+
+        num_columns++;
+    }
+
+    ok = ok && (ret == SQLITE_DONE) && (num_columns == myFields.size());
+
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+bool SQLiteSink::createInsertionStatement(size_t num_rows, sqlite3_stmt** stmt)
+{
+    std::stringstream sql;
+
+    sql << "INSERT INTO " << myTable << "(";
+
+    for(size_t i=0; i<myFields.size(); i++)
+    {
+        if(i > 0)
+        {
+            sql << ", ";
+        }
+
+        sql << myFields[i].name;
+    }
+
+    sql << ") VALUES ";
+
+    for(size_t j=0; j<num_rows; j++)
+    {
+        if( j > 0 )
+        {
+            sql << ", ";
+        }
+
+        sql << "(";
+        for(size_t i=0; i<myFields.size(); i++)
+        {
+            if( i > 0 )
+            {
+                sql << ", ";
+            }
+            sql << "?";
+        }
+        sql << ")";
+    }
+
+    return (SQLITE_OK == sqlite3_prepare_v2(myDatabase, sql.str().c_str(), -1, stmt, nullptr));
+}
+
+bool SQLiteSink::flushRows()
+{
+    bool ok = true;
+
+    const size_t num_rows = myRowBuffer->getNumRows();
+
+    if(ok && myBulkLoad && myTransactionRows == 0 && num_rows > 0)
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, "BEGIN TRANSACTION", nullptr, nullptr, nullptr));
+    }
+
+    if(ok && myMultiStatement != nullptr && num_rows == myMaxPendingRows)
+    {
+        sqlite3_reset(myMultiStatement);
+        myRowBuffer->bind(myMultiStatement, 0, num_rows);
+        ok = (SQLITE_DONE == sqlite3_step(myMultiStatement));
+    }
+    else
+    {
+        for(size_t i=0; ok && i<num_rows; i++)
+        {
+            sqlite3_reset(mySingleStatement);
+            myRowBuffer->bind(mySingleStatement, i, 1);
+            ok = (SQLITE_DONE == sqlite3_step(mySingleStatement));
+        }
+    }
+
+    myTransactionRows += num_rows;
+    myRowBuffer->clear();
+
+    if(ok && myBulkLoad && myTransactionRows >= size_t(std::max(1, myRowsPerTransaction)))
+    {
+        ok = (SQLITE_OK == sqlite3_exec(myDatabase, "COMMIT", nullptr, nullptr, nullptr));
+        myTransactionRows = 0;
+    }
+
+    return ok;
+}
@@ -0,0 +1,72 @@
+
+#pragma once
+
+#include <sqlite3.h>
+#include "banesa_sink.h"
+
+class SQLiteSink : public Sink
+{
+public:
+
+    SQLiteSink(const std::string& path);
+
+    ~SQLiteSink() override;
+
+    // In bulk-load mode, rows are inserted with multi-row INSERT statements inside explicit transactions,
+    // and the database is put in WAL mode with relaxed synchronization.
+    void setBulkLoad(bool bulk_load, int rows_per_transaction=10000, int rows_per_statement=100);
+
+    // In append mode, an existing samples table is kept if its schema matches the fields, and
+    // every committed transaction is synchronized to disk so that an interrupted run can be resumed.
+    void setAppend(bool append);
+
+    // Table receiving the samples, "samples" by default. Other tables of the database are kept,
+    // which allows saving the results of an incremental re-evaluation next to the original ones.
+    void setTable(const std::string& table);
+
+    bool open(const std::vector<Field>& fields) override;
+
+    bool write(int sample, const std::vector<ValuePtr>& values) override;
+
+    bool getStoredSamples(std::vector<int>& samples) override;
+
+    // The statistics are saved to the run_stats table, replacing those of a previous run. Its shard column is 0, as for the first shard of a merged database.
+    bool writeStats(const std::vector<StatRecord>& records) override;
+
+    bool close() override;
+
+    // Merges shards written by SQLiteSinks with identical fields into a single database.
+    // The statistics of all the shards are merged in the run_stats table, with an additional shard column giving the index of their shard.
+    // If append is true, the samples are added to those of an existing database, whose samples table must have the same schema.
+    static bool merge(const std::string& path, const std::vector<std::string>& shard_paths, bool append=false);
+
+private:
+
+    class RowBuffer;
+
+private:
+
+    bool initializeDatabase();
+    bool checkSchema();
+    bool createInsertionStatement(size_t num_rows, sqlite3_stmt** stmt);
+    bool flushRows();
+
+private:
+
+    std::string myPath;
+    std::string myTable;
+
+    bool myBulkLoad;
+    bool myAppend;
+    int myRowsPerTransaction;
+    int myRowsPerStatement;
+
+    std::vector<Field> myFields;
+    sqlite3* myDatabase;
+    sqlite3_stmt* mySingleStatement;
+    sqlite3_stmt* myMultiStatement;
+    std::unique_ptr<RowBuffer> myRowBuffer;
+    size_t myMaxPendingRows;
+    size_t myTransactionRows;
+};
+
@@ -0,0 +1,221 @@
+#include "banesa_sqlite_source.h"
+
+// Fields of the current row of the statement. Columns are those of the graph.
+
+class SQLiteSource::Reader : public FieldReader
+{
+public:
+
+    Reader(sqlite3_stmt* stmt, const std::vector<int>& columns) : myColumns(columns)
+    {
+        myStatement = stmt;
+    }
+
+    bool readInteger(int column, int64_t& value) override
+    {
+        const bool ok = isAvailable(column);
+
+        if(ok)
+        {
+            value = sqlite3_column_int64(myStatement, myColumns[column]);
+        }
+
+        return ok;
+    }
+
+    bool readReal(int column, double& value) override
+    {
+        const bool ok = isAvailable(column);
+
+        if(ok)
+        {
+            value = sqlite3_column_double(myStatement, myColumns[column]);
+        }
+
+        return ok;
+    }
+
+    bool readText(int column, std::string& value) override
+    {
+        const bool ok = isAvailable(column);
+
+        if(ok)
+        {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(myStatement, myColumns[column]));
+            value.assign(text, sqlite3_column_bytes(myStatement, myColumns[column]));
+        }
+
+        return ok;
+    }
+
+    bool readBlob(int column, const void*& data, size_t& size) override
+    {
+        const bool ok = isAvailable(column);
+
+        if(ok)
+        {
+            data = sqlite3_column_blob(myStatement, myColumns[column]);
+            size = sqlite3_column_bytes(myStatement, myColumns[column]);
+        }
+
+        return ok;
+    }
+
+protected:
+
+    bool isAvailable(int column)
+    {
+        return (column >= 0 && size_t(column) < myColumns.size() && myColumns[column] >= 0 && sqlite3_column_type(myStatement, myColumns[column]) != SQLITE_NULL);
+    }
+
+protected:
+
+    sqlite3_stmt* myStatement;
+    const std::vector<int>& myColumns;
+};
+
+SQLiteSource::SQLiteSource(const std::string& path, const std::string& table)
+{
+    myPath = path;
+    myTable = table;
+    myDatabase = nullptr;
+    myStatement = nullptr;
+}
+
+SQLiteSource::~SQLiteSource()
+{
+    if(myDatabase != nullptr)
+    {
+        sqlite3_finalize(myStatement);
+        sqlite3_close_v2(myDatabase);
+    }
+}
+
+bool SQLiteSource::open(const std::vector<Field>& fields)
+{
+    bool ok = true;
+    sqlite3_stmt* stmt = nullptr;
+    int ret = SQLITE_ROW;
+    bool has_id = false;
+
+    myColumns.assign(fields.size(), -1);
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_open_v2(myPath.c_str(), &myDatabase, SQLITE_OPEN_READONLY, nullptr));
+    }
+
+    // the database may be written by a sink of the same run.
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_busy_timeout(myDatabase, 10000));
+    }
+
+    if(ok)
+    {
+        const std::string query = "PRAGMA table_info(" + myTable + ")";
+        ok = (SQLITE_OK == sqlite3_prepare_v2(myDatabase, query.c_str(), -1, &stmt, nullptr));
+    }
+
+    while(ok && (ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const int column = sqlite3_column_int(stmt, 0);
+        const std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+
+        has_id = has_id || (name == "id");
+
+        for(size_t i=0; i<fields.size(); i++)
+        {
+            if(fields[i].name == name)
+            {
+                myColumns[i] = column;
+            }
+        }
+    }
+
+    ok = ok && (ret == SQLITE_DONE) && has_id;
+
+    sqlite3_finalize(stmt);
+
+    if(ok)
+    {
+        const std::string query = "SELECT * FROM " + myTable + " WHERE id = ?";
+        ok = (SQLITE_OK == sqlite3_prepare_v2(myDatabase, query.c_str(), -1, &myStatement, nullptr));
+    }
+
+    return ok;
+}
+
+bool SQLiteSource::getSamples(std::vector<int>& samples)
+{
+    bool ok = true;
+    sqlite3_stmt* stmt = nullptr;
+    int ret = SQLITE_ROW;
+
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    samples.clear();
+
+    if(ok)
+    {
+        const std::string query = "SELECT id FROM " + myTable + " ORDER BY id";
+        ok = (SQLITE_OK == sqlite3_prepare_v2(myDatabase, query.c_str(), -1, &stmt, nullptr));
+    }
+
+    while(ok && (ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        samples.push_back(sqlite3_column_int(stmt, 0));
+    }
+
+    ok = ok && (ret == SQLITE_DONE);
+
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+bool SQLiteSource::read(int sample, const std::function<bool(FieldReader&)>& callback)
+{
+    bool ok = true;
+
+    std::lock_guard<std::mutex> lock(myMutex);
+
+    if(ok)
+    {
+        sqlite3_reset(myStatement);
+        sqlite3_bind_int(myStatement, 1, sample);
+        ok = (SQLITE_ROW == sqlite3_step(myStatement));
+    }
+
+    if(ok)
+    {
+        Reader reader(myStatement, myColumns);
+        ok = callback(reader);
+    }
+
+    // the read transaction ends here, so that a sink writing to the same database is not blocked.
+
+    sqlite3_reset(myStatement);
+
+    return ok;
+}
+
+bool SQLiteSource::close()
+{
+    bool ok = true;
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_finalize(myStatement));
+        myStatement = nullptr;
+    }
+
+    if(ok)
+    {
+        ok = (SQLITE_OK == sqlite3_close_v2(myDatabase));
+        myDatabase = nullptr;
+    }
+
+    return ok;
+}
@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <mutex>
+#include <sqlite3.h>
+#include "banesa_sink.h"
+
+// Reads back the samples saved by a SQLiteSink. Fields are matched by name, so that a graph whose fields
+// differ from those of the stored run can still read the fields they have in common.
+
+class SQLiteSource : public SampleSource
+{
+public:
+
+    SQLiteSource(const std::string& path, const std::string& table="samples");
+
+    ~SQLiteSource() override;
+
+    bool open(const std::vector<Field>& fields) override;
+
+    bool getSamples(std::vector<int>& samples) override;
+
+    bool read(int sample, const std::function<bool(FieldReader&)>& callback) override;
+
+    bool close() override;
+
+private:
+
+    class Reader;
+
+private:
+
+    std::string myPath;
+    std::string myTable;
+
+    sqlite3* myDatabase;
+    sqlite3_stmt* myStatement;
+    std::vector<int> myColumns;
+    std::mutex myMutex;
+};
@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include <utility>
+#include <type_traits>
+#include "banesa_core.h"
+
+template<typename... T>
+struct Inputs
+{
+};
+
+template<typename... T>
+struct Outputs
+{
+};
+
+// Node whose input and output value types are known at compile time.
+// The types are checked once before sampling, then getTypedSample() receives typed references
+// without any dynamic cast. For example:
+//
+//   class MyNode : public TypedNode< Inputs<RealValue, SE3Value>, Outputs<SE3Value> >
+//   {
+//       void getTypedSample(SampleContext& context, const RealValue& a, const SE3Value& b, SE3Value& c) override;
+//   };
+
+template<typename I, typename O>
+class TypedNode;
+
+template<typename... I, typename... O>
+class TypedNode< Inputs<I...>, Outputs<O...> > : public Node
+{
+public:
+
+    virtual void getTypedSample(SampleContext& context, const I&... input, O&... output) = 0;
+
+    void getSample(SampleContext& context, const ValueSpan& input, const ValueSpan& output) final
+    {
+        call(context, input, output, std::index_sequence_for<I...>(), std::index_sequence_for<O...>());
+    }
+
+    bool checkValues(const ValueSpan& input, const ValueSpan& output) override
+    {
+        bool ret = (input.size() == sizeof...(I) && output.size() == sizeof...(O));
+
+        if(ret)
+        {
+            ret = checkTypes<I...>(input, 0) && checkTypes<O...>(output, 0);
+        }
+
+        return ret;
+    }
+
+private:
+
+    template<size_t... IS, size_t... OS>
+    void call(SampleContext& context, const ValueSpan& input, const ValueSpan& output, std::index_sequence<IS...>, std::index_sequence<OS...>)
+    {
+        getTypedSample(context, static_cast<const I&>(*input[IS])..., static_cast<O&>(*output[OS])...);
+    }
+
+    template<typename... T>
+    static typename std::enable_if<sizeof...(T) == 0, bool>::type checkTypes(const ValueSpan& values, size_t index)
+    {
+        return true;
+    }
+
+    template<typename T, typename... Rest>
+    static bool checkTypes(const ValueSpan& values, size_t index)
+    {
+        static_assert(std::is_base_of<Value, T>::value, "Port types must derive from Value!");
+        return (dynamic_cast<T*>(values[index].get()) != nullptr) && checkTypes<Rest...>(values, index+1);
+    }
+};
+